@@ -13,8 +13,15 @@ INCLUDEPATH += source \
 SOURCES += source/main.cpp \
     source/mainwindow.cpp \
     source/filehashingthread.cpp \
+    source/filehashingqueue.cpp \
+    source/filereadingthread.cpp \
+    source/blockring.cpp \
+    source/bufferpool.cpp \
+    source/iouring.cpp \
+    source/hashingtuner.cpp \
     source/filehasher.cpp \
     source/cryptohash.cpp \
+    source/paralleltth.cpp \
     source/qt4support.cpp \
     source/libtomcrypt/hashes/ltc_rmd320.c \
     source/libtomcrypt/hashes/ltc_rmd256.c \
@@ -28,6 +35,7 @@ SOURCES += source/main.cpp \
     source/libtomcrypt/hashes/helper/ltc_hash_filehandle.c \
     source/libtomcrypt/hashes/helper/ltc_hash_file.c \
     source/libtomcrypt/misc/ltc_zeromem.c \
+    source/libtomcrypt/misc/ltc_cpu_features.c \
     source/libtomcrypt/misc/crypt/ltc_crypt_argchk.c \
     source/libtomcrypt/misc/crypt/ltc_crypt_hash_is_valid.c \
     source/libtomcrypt/misc/crypt/ltc_crypt_hash_descriptor.c \
@@ -49,13 +57,24 @@ SOURCES += source/main.cpp \
     source/librhash/byte_order.c \
     source/librhash/aich.c \
     source/bytearraycodec.cpp \
+    source/multibufferhash.cpp \
     source/multihash.cpp \
+    source/checkpointstore.cpp \
+    source/cpuplacement.cpp \
+    source/hashingthrottle.cpp \
     source/qt4helper.cpp \
     source/sighand.cpp
 HEADERS += source/mainwindow.h \
     source/filehashingthread.h \
+    source/filehashingqueue.h \
+    source/filereadingthread.h \
+    source/blockring.h \
+    source/bufferpool.h \
+    source/iouring.h \
+    source/hashingtuner.h \
     source/filehasher.h \
     source/cryptohash.h \
+    source/paralleltth.h \
     source/qt4support.h \
     source/feature.h \
     source/libtomcrypt/headers/tomcrypt_misc.h \
@@ -78,7 +97,11 @@ HEADERS += source/mainwindow.h \
     source/librhash/aich.h \
     source/librhash/tiger.h \
     source/bytearraycodec.h \
+    source/multibufferhash.h \
     source/multihash.h \
+    source/checkpointstore.h \
+    source/cpuplacement.h \
+    source/hashingthrottle.h \
     source/qt4helper.h \
     source/sighand.h
 FORMS += source/mainwindow.ui
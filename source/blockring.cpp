@@ -0,0 +1,106 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QMutexLocker>
+#include "blockring.h"
+
+CBlockRing::CBlockRing()
+{
+ m_BlockSize = 0;
+ reset();
+}
+
+void CBlockRing::setup(const QVector<char*>& blocks, const int blockSize)
+{
+ m_Blocks = blocks;
+ m_Lengths.fill(0,blocks.count());
+ m_BlockSize = blockSize;
+ reset();
+}
+
+void CBlockRing::reset(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Head = 0;
+ m_Tail = 0;
+ m_Count = 0;
+ m_Closed = false;
+ m_Aborted = false;
+ m_Failed = false;
+}
+
+char* CBlockRing::acquireFree(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ while (!m_Aborted && (m_Count == m_Blocks.count()))
+ {
+  m_NotFull.wait(&m_Mutex);
+ }
+ if (m_Aborted) return NULL;
+ return m_Blocks.at(m_Head);
+}
+
+void CBlockRing::commit(const int length)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Lengths[m_Head] = length;
+ m_Head = (m_Head+1) % m_Blocks.count();
+ m_Count++;
+ m_NotEmpty.wakeOne();
+}
+
+void CBlockRing::close(const bool status)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Closed = true;
+ m_Failed = !status;
+ m_NotEmpty.wakeOne();
+}
+
+const char* CBlockRing::acquireFull(int& length)
+{
+ QMutexLocker locker(&m_Mutex);
+ while (!m_Closed && (0 == m_Count))
+ {
+  m_NotEmpty.wait(&m_Mutex);
+ }
+ if (0 == m_Count) return NULL;
+ length = m_Lengths.at(m_Tail);
+ return m_Blocks.at(m_Tail);
+}
+
+void CBlockRing::release(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Tail = (m_Tail+1) % m_Blocks.count();
+ m_Count--;
+ m_NotFull.wakeOne();
+}
+
+void CBlockRing::abort(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Aborted = true;
+ m_NotFull.wakeOne();
+}
+
+bool CBlockRing::failed(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ return m_Failed;
+}
@@ -0,0 +1,67 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLOCKRING_H
+#define BLOCKRING_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+/** \brief Bounded ring of preallocated data blocks passed from a single
+    producer (file reader) to a single consumer (hash function). */
+class CBlockRing
+{
+ private:
+  QVector<char*> m_Blocks;
+  QVector<int> m_Lengths;
+  int m_BlockSize;
+  int m_Head;
+  int m_Tail;
+  int m_Count;
+  bool m_Closed;
+  bool m_Aborted;
+  bool m_Failed;
+  QMutex m_Mutex;
+  QWaitCondition m_NotEmpty;
+  QWaitCondition m_NotFull;
+ public:
+  /** \brief Sets blocks to circulate, should be called while the ring is unused.
+      Blocks are owned by the caller. */
+  void setup(const QVector<char*>& blocks, const int blockSize);
+  const QVector<char*>& blocks(void) { return m_Blocks; }
+  /** \brief Empties the ring before passing a new file through it. */
+  void reset(void);
+  int blockSize(void) { return m_BlockSize; }
+  /** \brief Producer: waits for a free block, returns NULL if consumer aborted. */
+  char* acquireFree(void);
+  /** \brief Producer: passes the block taken with acquireFree() to consumer. */
+  void commit(const int length);
+  /** \brief Producer: marks the end of data, successful or not. */
+  void close(const bool status);
+  /** \brief Consumer: waits for a filled block, returns NULL at the end of data. */
+  const char* acquireFull(int& length);
+  /** \brief Consumer: returns the block taken with acquireFull() to producer. */
+  void release(void);
+  /** \brief Consumer: stops producer, remaining data is discarded. */
+  void abort(void);
+  bool failed(void);
+  CBlockRing();
+};
+
+#endif // BLOCKRING_H
@@ -0,0 +1,122 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QMutexLocker>
+#include "bufferpool.h"
+
+#ifdef Q_OS_UNIX
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+CBufferPool::CBufferPool()
+{
+ m_Memory = NULL;
+ m_MemorySize = 0;
+ m_BufferSize = 0;
+ m_BufferCount = 0;
+ m_HugePages = false;
+ m_HugePagesInUse = false;
+}
+
+CBufferPool::~CBufferPool()
+{
+ releaseMemory();
+}
+
+void CBufferPool::releaseMemory(void)
+{
+ if (NULL != m_Memory)
+ {
+#ifdef Q_OS_UNIX
+  ::free(m_Memory);
+#else
+  qFreeAligned(m_Memory);
+#endif
+  m_Memory = NULL;
+ }
+ m_MemorySize = 0;
+ m_FreeBuffers.clear();
+}
+
+bool CBufferPool::setup(const int bufferCount, const int bufferSize)
+{
+ QMutexLocker locker(&m_Mutex);
+ // keep existing memory if the same layout is requested again
+ if ((NULL != m_Memory) && (bufferCount == m_BufferCount) &&
+     (bufferSize == m_BufferSize) && (m_HugePages == m_HugePagesInUse))
+ {
+  return true;
+ }
+ releaseMemory();
+ m_BufferCount = 0;
+ m_BufferSize = 0;
+#ifdef Q_OS_UNIX
+ const int pageSize = (int)sysconf(_SC_PAGESIZE);
+#else
+ const int pageSize = 0x1000;
+#endif
+ // buffers are rounded up to whole pages to keep every one of them aligned
+ const int alignedSize = (bufferSize+pageSize-1)/pageSize*pageSize;
+ const qint64 memorySize = (qint64)alignedSize*bufferCount;
+ if (memorySize <= 0) return false;
+#ifdef Q_OS_UNIX
+ const size_t alignment = m_HugePages ? 0x200000 : pageSize;
+ void *memory = NULL;
+ if (0 != posix_memalign(&memory,alignment,(size_t)memorySize)) return false;
+ m_Memory = (char *)memory;
+#ifdef MADV_HUGEPAGE
+ if (m_HugePages) madvise(m_Memory,(size_t)memorySize,MADV_HUGEPAGE);
+#endif
+#else
+ m_Memory = (char *)qMallocAligned((size_t)memorySize,pageSize);
+ if (NULL == m_Memory) return false;
+#endif
+ m_MemorySize = memorySize;
+ m_HugePagesInUse = m_HugePages;
+ m_BufferCount = bufferCount;
+ m_BufferSize = bufferSize;
+ m_FreeBuffers.reserve(bufferCount);
+ for (int i = 0; i < bufferCount; i++)
+ {
+  m_FreeBuffers.append(m_Memory+(qint64)alignedSize*i);
+ }
+ return true;
+}
+
+char* CBufferPool::acquire(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ if (0 == m_BufferCount) return NULL;
+ while (m_FreeBuffers.isEmpty())
+ {
+  m_BufferReleased.wait(&m_Mutex);
+ }
+ char *buffer = m_FreeBuffers.last();
+ m_FreeBuffers.remove(m_FreeBuffers.count()-1);
+ return buffer;
+}
+
+void CBufferPool::release(char *buffer)
+{
+ if (NULL == buffer) return;
+ QMutexLocker locker(&m_Mutex);
+ m_FreeBuffers.append(buffer);
+ m_BufferReleased.wakeOne();
+}
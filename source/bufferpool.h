@@ -0,0 +1,56 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+/** \brief Pool of equally sized page-aligned buffers carved out of a single
+    allocation, which is made once per hashing job and reused for every file. */
+class CBufferPool
+{
+ private:
+  char *m_Memory;
+  qint64 m_MemorySize;
+  int m_BufferSize;
+  int m_BufferCount;
+  bool m_HugePages;
+  bool m_HugePagesInUse;
+  QVector<char*> m_FreeBuffers;
+  QMutex m_Mutex;
+  QWaitCondition m_BufferReleased;
+  void releaseMemory(void);
+ public:
+  /** \brief (Re)allocates pool memory, should be called while no buffers are in use. */
+  bool setup(const int bufferCount, const int bufferSize);
+  /** \brief Takes a buffer from the pool, waits if all buffers are in use. */
+  char* acquire(void);
+  /** \brief Returns a buffer taken with acquire() to the pool. */
+  void release(char *buffer);
+  int bufferSize(void) { return m_BufferSize; }
+  int bufferCount(void) { return m_BufferCount; }
+  /** \brief Enables backing of pool memory with transparent huge pages where supported. */
+  bool& useHugePages(void) { return m_HugePages; }
+  CBufferPool();
+  ~CBufferPool();
+};
+
+#endif // BUFFERPOOL_H
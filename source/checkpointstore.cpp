@@ -0,0 +1,159 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include "checkpointstore.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const quint32 CheckpointMagic = 0x51464843; // "QFHC"
+static const quint32 CheckpointVersion = 1;
+
+bool CCheckpointStore::setup(const QString& directory)
+{
+ m_Directory = directory;
+ if (m_Directory.isEmpty()) return false;
+ return QDir().mkpath(m_Directory);
+}
+
+QString CCheckpointStore::checkpointPath(const QString& filePath, const QString& algorithm)
+{
+ // one checkpoint per file and algorithm, named after both
+ QByteArray key = QFileInfo(filePath).absoluteFilePath().toUtf8();
+ key.append('\n').append(algorithm.toUtf8());
+ return m_Directory+"/"+QString(QCryptographicHash::hash(key,QCryptographicHash::Sha1).toHex())+".ckpt";
+}
+
+bool CCheckpointStore::identify(const QString& filePath, CCheckpointStore::identity_t& identity)
+{
+#ifdef Q_OS_UNIX
+ struct stat info;
+ if (0 != stat(QFile::encodeName(filePath).constData(),&info)) return false;
+ identity.size = info.st_size;
+ identity.modified = info.st_mtime;
+#ifdef Q_OS_LINUX
+ identity.modifiedNsec = info.st_mtim.tv_nsec;
+#else
+ identity.modifiedNsec = 0;
+#endif
+ identity.inode = info.st_ino;
+ identity.device = info.st_dev;
+#else
+ QFileInfo info(filePath);
+ if (!info.exists()) return false;
+ identity.size = info.size();
+ identity.modified = info.lastModified().toTime_t();
+ identity.modifiedNsec = 0;
+ identity.inode = 0;
+ identity.device = 0;
+#endif
+ return true;
+}
+
+bool CCheckpointStore::load(const QString& filePath, const QString& algorithm,
+                            const CCheckpointStore::identity_t& identity,
+                            qint64& offset, QByteArray& state)
+{
+ if (m_Directory.isEmpty()) return false;
+ QFile file(checkpointPath(filePath,algorithm));
+ if (!file.open(QIODevice::ReadOnly)) return false;
+ QDataStream stream(&file);
+ stream.setVersion(QDataStream::Qt_4_0);
+ quint32 magic = 0, version = 0;
+ QString path, name;
+ identity_t saved;
+ stream >> magic >> version;
+ if ((CheckpointMagic != magic) || (CheckpointVersion != version)) return false;
+ stream >> path >> name >> saved.size >> saved.modified >> saved.modifiedNsec
+        >> saved.inode >> saved.device >> offset >> state;
+ file.close();
+ const bool valid = (QDataStream::Ok == stream.status()) &&
+  (QFileInfo(filePath).absoluteFilePath() == path) && (algorithm == name) &&
+  (identity.size == saved.size) && (identity.modified == saved.modified) &&
+  (identity.modifiedNsec == saved.modifiedNsec) &&
+  (identity.inode == saved.inode) && (identity.device == saved.device) &&
+  (offset > 0) && (offset <= identity.size);
+ // a checkpoint of a changed file is of no use anymore
+ if (!valid) file.remove();
+ return valid;
+}
+
+bool CCheckpointStore::save(const QString& filePath, const QString& algorithm,
+                            const CCheckpointStore::identity_t& identity,
+                            const qint64 offset, const QByteArray& state)
+{
+ if (m_Directory.isEmpty() || state.isEmpty()) return false;
+ const QString path = checkpointPath(filePath,algorithm);
+ QFile file(path+".tmp");
+ if (!file.open(QIODevice::WriteOnly|QIODevice::Truncate)) return false;
+ {
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_0);
+  stream << CheckpointMagic << CheckpointVersion
+         << QFileInfo(filePath).absoluteFilePath() << algorithm
+         << identity.size << identity.modified << identity.modifiedNsec
+         << identity.inode << identity.device << offset << state;
+ }
+ bool status = file.flush();
+#ifdef Q_OS_UNIX
+ // the new checkpoint must be on disk before it replaces the old one,
+ // or a power loss may leave the name pointing at a partial file
+ status = status && (0 == ::fsync(file.handle()));
+#endif
+ file.close();
+ if (!status || (QFile::NoError != file.error()))
+ {
+  file.remove();
+  return false;
+ }
+#ifdef Q_OS_UNIX
+ // replaces the previous checkpoint atomically
+ if (0 != ::rename(QFile::encodeName(file.fileName()).constData(),
+                   QFile::encodeName(path).constData()))
+ {
+  return false;
+ }
+ // and makes the rename itself durable
+ const int directory = ::open(QFile::encodeName(m_Directory).constData(),O_RDONLY);
+ if (directory >= 0)
+ {
+  ::fsync(directory);
+  ::close(directory);
+ }
+ return true;
+#else
+ QFile::remove(path);
+ return file.rename(path);
+#endif
+}
+
+void CCheckpointStore::remove(const QString& filePath, const QString& algorithm)
+{
+ if (m_Directory.isEmpty()) return;
+ QFile::remove(checkpointPath(filePath,algorithm));
+}
@@ -0,0 +1,65 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECKPOINTSTORE_H
+#define CHECKPOINTSTORE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+/** \brief Keeps intermediate hashing state of large files across runs.
+
+    A checkpoint holds the offset up to which a file was hashed and the state
+    of the hash at that offset. It is bound to the file by its size,
+    modification time and, where the system has them, inode and device
+    numbers; a checkpoint of a file that changed in any of these is dropped.
+    Checkpoints are written to a temporary file first, flushed to disk and
+    renamed over the previous one, so a crash or power loss leaves either the
+    old or the new checkpoint. Elsewhere than on Unix the previous checkpoint
+    is removed before the rename and may be lost instead. */
+class CCheckpointStore
+{
+ public:
+  struct identity_t
+  {
+   qint64 size;
+   qint64 modified;
+   qint64 modifiedNsec;
+   quint64 inode;
+   quint64 device;
+  };
+ private:
+  QString m_Directory;
+  QString checkpointPath(const QString& filePath, const QString& algorithm);
+ public:
+  /** \brief Sets the directory checkpoints are kept in, creates it if needed. */
+  bool setup(const QString& directory);
+  QString directory(void) { return m_Directory; }
+  /** \brief Takes identity of a file, returns false if it can not be examined. */
+  static bool identify(const QString& filePath, CCheckpointStore::identity_t& identity);
+  /** \brief Finds checkpoint of a file, returns false if there is none or the file changed. */
+  bool load(const QString& filePath, const QString& algorithm,
+            const CCheckpointStore::identity_t& identity,
+            qint64& offset, QByteArray& state);
+  bool save(const QString& filePath, const QString& algorithm,
+            const CCheckpointStore::identity_t& identity,
+            const qint64 offset, const QByteArray& state);
+  void remove(const QString& filePath, const QString& algorithm);
+};
+
+#endif // CHECKPOINTSTORE_H
@@ -0,0 +1,222 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include "cpuplacement.h"
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+// memory policy constants of <numaif.h>, which needs libnuma to link
+static const int PreferredPolicy = 1;
+static const unsigned MoveFlag = 1 << 1;
+static const int MaxNodes = 1024;
+#endif
+
+CCpuPlacement::CCpuPlacement()
+{
+ m_NodeCount = 0;
+}
+
+QVector<int> CCpuPlacement::parseCpuList(const QString& list)
+{
+ QVector<int> cpus;
+ const QStringList ranges = list.split(',',QString::SkipEmptyParts);
+ for (int i = 0, n = ranges.count(); i < n; i++)
+ {
+  const QString range = ranges.at(i).trimmed();
+  bool firstValid, lastValid = true;
+  const int first = range.section('-',0,0).toInt(&firstValid);
+  const int last = range.contains('-') ? range.section('-',1,1).toInt(&lastValid) : first;
+  if (!firstValid || !lastValid || (first < 0) || (last < first)) continue;
+  for (int cpu = first; cpu <= last; cpu++)
+  {
+   if (!cpus.contains(cpu)) cpus.append(cpu);
+ }}
+ qSort(cpus);
+ return cpus;
+}
+
+void CCpuPlacement::readNodes(void)
+{
+ m_CpuNodes.clear();
+ m_NodeCount = 0;
+#ifdef Q_OS_LINUX
+ const QStringList nodes = QDir("/sys/devices/system/node")
+                           .entryList(QStringList("node*"),QDir::Dirs);
+ for (int i = 0, n = nodes.count(); i < n; i++)
+ {
+  bool valid;
+  const int node = nodes.at(i).mid(4).toInt(&valid);
+  if (!valid || (node < 0) || (node >= MaxNodes)) continue;
+  QFile file("/sys/devices/system/node/"+nodes.at(i)+"/cpulist");
+  if (!file.open(QIODevice::ReadOnly)) continue;
+  const QVector<int> cpus = parseCpuList(QString::fromLatin1(file.readAll().constData()));
+  for (int j = 0, count = cpus.count(); j < count; j++)
+  {
+   if (cpus.at(j) >= m_CpuNodes.count()) m_CpuNodes.resize(cpus.at(j)+1);
+   m_CpuNodes[cpus.at(j)] = node+1;
+  }
+  m_NodeCount++;
+ }
+ // entries were filled with node+1, so that gaps read as -1
+ for (int i = 0, n = m_CpuNodes.count(); i < n; i++)
+ {
+  m_CpuNodes[i]--;
+ }
+#endif
+}
+
+int CCpuPlacement::nodeOf(const QVector<int>& cpus)
+{
+ // memory of a single node machine needs no placing
+ if ((m_NodeCount < 2) || cpus.isEmpty()) return -1;
+ int node = -1;
+ for (int i = 0, n = cpus.count(); i < n; i++)
+ {
+  const int cpuNode = (cpus.at(i) < m_CpuNodes.count()) ? m_CpuNodes.at(cpus.at(i)) : -1;
+  if ((cpuNode < 0) || ((node >= 0) && (cpuNode != node))) return -1;
+  node = cpuNode;
+ }
+ return node;
+}
+
+bool CCpuPlacement::setup(const CCpuPlacement::Mode mode, const QString& cpuGroups,
+                          const QString& reservedCpus)
+{
+ m_Groups.clear();
+ m_AllowedCpus.clear();
+#ifdef Q_OS_LINUX
+ cpu_set_t set;
+ CPU_ZERO(&set);
+ if (0 != sched_getaffinity(0,sizeof(set),&set)) return false;
+ const QVector<int> reserved = parseCpuList(reservedCpus);
+ for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+ {
+  if (CPU_ISSET(cpu,&set) && !reserved.contains(cpu)) m_AllowedCpus.append(cpu);
+ }
+ if (m_AllowedCpus.isEmpty()) return false;
+ readNodes();
+ QList<QVector<int> > groups;
+ if (CCpuPlacement::Automatic == mode)
+ {
+  for (int node = 0; node < MaxNodes; node++)
+  {
+   QVector<int> cpus;
+   for (int i = 0, n = m_CpuNodes.count(); i < n; i++)
+   {
+    if (m_CpuNodes.at(i) == node) cpus.append(i);
+   }
+   if (!cpus.isEmpty()) groups.append(cpus);
+   if (groups.count() == m_NodeCount) break;
+ }}
+ else if (CCpuPlacement::Listed == mode)
+ {
+  const QStringList lists = cpuGroups.split(';',QString::SkipEmptyParts);
+  for (int i = 0, n = lists.count(); i < n; i++)
+  {
+   groups.append(parseCpuList(lists.at(i)));
+ }}
+ // only CPUs the process may use and that are not reserved stay in groups
+ for (int i = 0, n = groups.count(); i < n; i++)
+ {
+  group_t group;
+  for (int j = 0, count = groups.at(i).count(); j < count; j++)
+  {
+   if (m_AllowedCpus.contains(groups.at(i).at(j))) group.cpus.append(groups.at(i).at(j));
+  }
+  if (group.cpus.isEmpty()) continue;
+  group.node = nodeOf(group.cpus);
+  m_Groups.append(group);
+ }
+ return true;
+#else
+ Q_UNUSED(mode);
+ Q_UNUSED(cpuGroups);
+ Q_UNUSED(reservedCpus);
+ return true;
+#endif
+}
+
+int CCpuPlacement::cpuCount(void)
+{
+ if (m_Groups.isEmpty()) return m_AllowedCpus.count();
+ int count = 0;
+ for (int i = 0, n = m_Groups.count(); i < n; i++)
+ {
+  count += m_Groups.at(i).cpus.count();
+ }
+ return count;
+}
+
+int CCpuPlacement::workerNode(const int worker)
+{
+ if (m_Groups.isEmpty()) return -1;
+ return m_Groups.at(worker%m_Groups.count()).node;
+}
+
+bool CCpuPlacement::setAffinity(const QVector<int>& cpus)
+{
+#ifdef Q_OS_LINUX
+ cpu_set_t set;
+ CPU_ZERO(&set);
+ for (int i = 0, n = cpus.count(); i < n; i++)
+ {
+  if (cpus.at(i) < CPU_SETSIZE) CPU_SET(cpus.at(i),&set);
+ }
+ // the calling thread only, not the whole process
+ return (0 == sched_setaffinity(0,sizeof(set),&set));
+#else
+ Q_UNUSED(cpus);
+ return false;
+#endif
+}
+
+bool CCpuPlacement::apply(const int worker)
+{
+ // workers are reused by later jobs, an unpinned one gets all allowed CPUs back
+ if (m_Groups.isEmpty())
+ {
+  return !m_AllowedCpus.isEmpty() && setAffinity(m_AllowedCpus);
+ }
+ return setAffinity(m_Groups.at(worker%m_Groups.count()).cpus);
+}
+
+bool CCpuPlacement::bindMemory(void *memory, const qint64 size, const int node)
+{
+#if defined(Q_OS_LINUX) && defined(SYS_mbind)
+ if ((NULL == memory) || (size <= 0) || (node < 0) || (node >= MaxNodes)) return false;
+ const int bits = 8*sizeof(unsigned long);
+ unsigned long mask[MaxNodes/(8*sizeof(unsigned long))] = { 0 };
+ mask[node/bits] = 1UL << (node%bits);
+ // pages already touched on another node are migrated, failure to do so is harmless
+ return (0 == syscall(SYS_mbind,memory,(unsigned long)size,PreferredPolicy,
+                      mask,(unsigned long)MaxNodes,MoveFlag));
+#else
+ Q_UNUSED(memory);
+ Q_UNUSED(size);
+ Q_UNUSED(node);
+ return false;
+#endif
+}
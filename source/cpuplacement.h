@@ -0,0 +1,77 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CPUPLACEMENT_H
+#define CPUPLACEMENT_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/** \brief Places hashing workers on CPUs and their buffers on memory nodes.
+
+    CPUs are split into groups, workers are spread over the groups round
+    robin and each worker may only run on the CPUs of its group. In automatic
+    mode every NUMA node listed in /sys/devices/system/node makes a group, so
+    workers stay on one socket and their buffers are allocated from memory of
+    that socket. Listed mode takes groups from the user. Reserved CPUs are
+    left out of every group, and the remaining ones are still limited by the
+    affinity of the process. Threads started by a worker inherit its CPUs.
+    Placement is done on Linux only, elsewhere it does nothing. */
+class CCpuPlacement
+{
+ public:
+  /** \brief Unpinned workers run on any CPU that is not reserved. */
+  enum Mode { Unpinned, Listed, Automatic };
+ private:
+  struct group_t
+  {
+   QVector<int> cpus;
+   /** \brief Memory node all CPUs of the group belong to, -1 if none. */
+   int node;
+  };
+  QVector<group_t> m_Groups;
+  /** \brief CPUs of workers when groups can not be made. */
+  QVector<int> m_AllowedCpus;
+  /** \brief Memory node of every CPU, -1 for CPUs of no known node. */
+  QVector<int> m_CpuNodes;
+  int m_NodeCount;
+  void readNodes(void);
+  int nodeOf(const QVector<int>& cpus);
+  bool setAffinity(const QVector<int>& cpus);
+ public:
+  /** \brief Parses a CPU list in the format of sysfs, such as "0-3,8,10-11". */
+  static QVector<int> parseCpuList(const QString& list);
+  /** \brief Prepares placement of a job, should be called from the main thread.
+
+      Groups of listed mode are separated by semicolons, such as "0-7;8-15".
+      Returns false if no CPU is left for workers, they run unpinned then. */
+  bool setup(const CCpuPlacement::Mode mode, const QString& cpuGroups,
+             const QString& reservedCpus);
+  /** \brief Number of CPUs workers may run on, 0 if not known. */
+  int cpuCount(void);
+  /** \brief Memory node of given worker, -1 if its memory is not placed. */
+  int workerNode(const int worker);
+  /** \brief Binds calling thread to the CPUs of given worker. */
+  bool apply(const int worker);
+  /** \brief Moves page-aligned memory to given node, pages not yet touched
+      are allocated there as well. */
+  static bool bindMemory(void *memory, const qint64 size, const int node);
+  CCpuPlacement();
+};
+
+#endif // CPUPLACEMENT_H
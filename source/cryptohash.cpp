@@ -16,12 +16,20 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
+#include <QtCore/QDataStream>
 #include "cryptohash.h"
+#include "paralleltth.h"
+
+static const quint32 StateVersion = 1;
 
 CCryptographicHash::CCryptographicHash(Algorithm method, const qint64 size)
 {
  m_Method = method;
+ m_ParallelTth = NULL;
 #ifdef FEATURE_LIB_RHASH
+ // algorithms of other libraries leave rhash idle
+ m_Context_rhash.flags = (rhash::crc_sum_flags)0;
  switch (m_Method)
  {
   case Crc32: { m_Context_rhash.flags = rhash::FLAG_CRC32; break; }
@@ -39,7 +47,7 @@ CCryptographicHash::CCryptographicHash(Algorithm method, const qint64 size)
  //
 #endif
 #ifdef FEATURE_LIB_TOMCRYPT
- //
+ // SHA-2 kernels are chosen by the library on first use
 #endif
 #ifdef FEATURE_QT_HASH
  m_QtHash = NULL;
@@ -48,12 +56,22 @@ CCryptographicHash::CCryptographicHash(Algorithm method, const qint64 size)
   case Md4:
 #ifdef FEATURE_PREFER_QT_NATIVE_HASH
   case Md5:
-  case Sha1:
 #endif
   {
    m_QtHash = new QCryptographicHash(qtAlgorithm(method));
    break;
   }
+#ifdef FEATURE_PREFER_QT_NATIVE_HASH
+  case Sha1:
+  {
+#ifdef FEATURE_LIB_RHASH
+   // SHA extensions of the CPU make rhash outrun Qt
+   if (rhash::sha1_accelerated()) break;
+#endif
+   m_QtHash = new QCryptographicHash(qtAlgorithm(method));
+   break;
+  }
+#endif
  }
 #endif
  reset(size);
@@ -70,6 +88,9 @@ void CCryptographicHash::reset(const qint64 size)
 {
 #ifdef FEATURE_LIB_RHASH
  crc_sums_init(&m_Context_rhash.state,m_Context_rhash.flags,size);
+#if defined FEATURE_QT_HASH && !defined FEATURE_LIB_TOMCRYPT_MD4
+ if (Md4 == m_Method) rhash::md4_init(&m_Context_rhash.md4state);
+#endif
 #endif
 #ifdef FEATURE_LIB_SHA2
  switch (m_Method)
@@ -136,10 +157,22 @@ void CCryptographicHash::reset(const qint64 size)
 void CCryptographicHash::addData(const char *data, int length)
 {
 #ifdef FEATURE_LIB_RHASH
+#ifdef FEATURE_LIB_RHASH_TTH
+ // large blocks of a tree hash are split into subtrees hashed in parallel
+ if ((Tth == m_Method) && m_ParallelTth && ((unsigned)length >= CParallelTth::MinimumSize))
+  m_ParallelTth->update(&m_Context_rhash.state.tth_context,(const unsigned char *)data,length);
+ else
+#endif
 #ifdef FEATURE_QT_HASH
  if (!m_QtHash)
 #endif
  rhash::crc_sums_update(&m_Context_rhash.state,(const unsigned char *)data,length);
+#if defined FEATURE_QT_HASH && !defined FEATURE_LIB_TOMCRYPT_MD4
+ if ((Md4 == m_Method) && !m_QtHash)
+ {
+  rhash::md4_update(&m_Context_rhash.md4state,(const unsigned char *)data,length);
+ }
+#endif
 #endif
 #ifdef FEATURE_LIB_SHA2
  switch (m_Method)
@@ -228,6 +261,19 @@ QByteArray CCryptographicHash::result()
                          sizeof(m_Context_rhash.digest.ed2k_digest));
    break;
   }
+#if defined FEATURE_QT_HASH && !defined FEATURE_LIB_TOMCRYPT_MD4
+  case Md4:
+  {
+   if (!m_QtHash)
+   {
+    rhash::md4_ctx context = m_Context_rhash.md4state;
+    unsigned char digest[16];
+    rhash::md4_final(&context,digest);
+    m_Result = QByteArray((const char *)digest,sizeof(digest));
+   }
+   break;
+  }
+#endif
 #ifdef FEATURE_LIB_RHASH_TIGER
   case Tiger:
   {
@@ -436,6 +482,136 @@ QByteArray CCryptographicHash::result()
  return m_Result;
 }
 
+bool CCryptographicHash::isSerializable(void)
+{
+#ifdef FEATURE_QT_HASH
+ // state of Qt hashes is private to Qt
+ return (NULL == m_QtHash);
+#else
+ return true;
+#endif
+}
+
+bool CCryptographicHash::makeSerializable(void)
+{
+#ifdef FEATURE_QT_HASH
+ // MD5 and SHA1 of rhash run alongside Qt ones anyway, MD4 has its own context
+ if (m_QtHash)
+ {
+  delete m_QtHash;
+  m_QtHash = NULL;
+ }
+#endif
+ reset();
+ return isSerializable();
+}
+
+QByteArray CCryptographicHash::saveState(void)
+{
+ QByteArray state;
+ if (!isSerializable()) return state;
+ // contexts are plain structures, they are saved as they are in memory;
+ // their sizes are saved too, to tell states of other builds
+ QDataStream stream(&state,QIODevice::WriteOnly);
+ stream << StateVersion << (qint32)m_Method << (qint32)Q_BYTE_ORDER;
+#ifdef FEATURE_LIB_RHASH
+ stream << QByteArray((const char *)&m_Context_rhash.state,sizeof(m_Context_rhash.state));
+ stream << QByteArray((const char *)&m_Context_rhash.md4state,sizeof(m_Context_rhash.md4state));
+#endif
+#ifdef FEATURE_LIB_SHA2
+ stream << QByteArray((const char *)&m_Context_sha2.sha256state,sizeof(m_Context_sha2.sha256state));
+ stream << QByteArray((const char *)&m_Context_sha2.sha512state,sizeof(m_Context_sha2.sha512state));
+#endif
+#ifdef FEATURE_LIB_TOMCRYPT
+ stream << QByteArray((const char *)&m_Context_ltc.state,sizeof(m_Context_ltc.state));
+#endif
+ return state;
+}
+
+static bool restoreContext(QDataStream& stream, void *context, const int size)
+{
+ QByteArray data;
+ stream >> data;
+ if ((QDataStream::Ok != stream.status()) || (data.size() != size)) return false;
+ memcpy(context,data.constData(),size);
+ return true;
+}
+
+bool CCryptographicHash::restoreState(const QByteArray& state)
+{
+ if (!isSerializable()) return false;
+ QDataStream stream(state);
+ quint32 version = 0;
+ qint32 method = -1, byteOrder = 0;
+ stream >> version >> method >> byteOrder;
+ if ((StateVersion != version) || (m_Method != method) || (Q_BYTE_ORDER != byteOrder))
+ {
+  return false;
+ }
+ // contexts are restored into copies, a broken state leaves the hash as it was
+ bool status = true;
+#ifdef FEATURE_LIB_RHASH
+ rhash_context_t rhashContext = m_Context_rhash;
+ status = status && restoreContext(stream,&rhashContext.state,sizeof(rhashContext.state));
+ status = status && restoreContext(stream,&rhashContext.md4state,sizeof(rhashContext.md4state));
+#endif
+#ifdef FEATURE_LIB_SHA2
+ sha2_context_t sha2Context = m_Context_sha2;
+ status = status && restoreContext(stream,&sha2Context.sha256state,sizeof(sha2Context.sha256state));
+ status = status && restoreContext(stream,&sha2Context.sha512state,sizeof(sha2Context.sha512state));
+#endif
+#ifdef FEATURE_LIB_TOMCRYPT
+ ltc_context_t ltcContext = m_Context_ltc;
+ status = status && restoreContext(stream,&ltcContext.state,sizeof(ltcContext.state));
+#endif
+ if (!status) return false;
+#ifdef FEATURE_LIB_RHASH
+ // flags come from the algorithm, not from the saved state
+ if (rhashContext.state.flags != m_Context_rhash.state.flags) return false;
+ m_Context_rhash = rhashContext;
+#endif
+#ifdef FEATURE_LIB_SHA2
+ m_Context_sha2 = sha2Context;
+#endif
+#ifdef FEATURE_LIB_TOMCRYPT
+ m_Context_ltc = ltcContext;
+#endif
+ m_Result.clear();
+ return true;
+}
+
+bool CCryptographicHash::isCombinable(const Algorithm algorithm)
+{
+#ifdef FEATURE_LIB_RHASH_CRC32
+ return (Crc32 == algorithm);
+#else
+ Q_UNUSED(algorithm);
+ return false;
+#endif
+}
+
+bool CCryptographicHash::combine(const QByteArray& rangeHash, const qint64 rangeLength)
+{
+#ifdef FEATURE_LIB_RHASH_CRC32
+ if ((Crc32 != m_Method) || (rangeHash.size() != (int)sizeof(unsigned)) || (rangeLength < 0))
+ {
+  return false;
+ }
+ // undo the byte reversal of result()
+ unsigned crc;
+ char *bytes = (char *)&crc;
+ for (int i = 0, n = sizeof(crc), j = n-1; i < n; i++,j--) bytes[j] = rangeHash.at(i);
+ m_Context_rhash.state.crc32 = rhash::crc32_combine(m_Context_rhash.state.crc32,crc,
+                                                    (quint64)rangeLength);
+ m_Result.clear();
+ return true;
+#else
+ Q_UNUSED(rangeHash);
+ Q_UNUSED(rangeLength);
+ return false;
+#endif
+}
+
 QByteArray CCryptographicHash::hash(const QByteArray &data, Algorithm method)
 {
  CCryptographicHash hash(method);
@@ -33,6 +33,7 @@
 namespace rhash
 {
  #include "crc_sums.h"
+ #include "crc32.h"
 }
 #endif
 
@@ -50,6 +51,8 @@ namespace ltc
 }
 #endif
 
+class CParallelTth;
+
 class CCryptographicHash : public QObject
 {
  Q_OBJECT
@@ -92,6 +95,8 @@ class CCryptographicHash : public QObject
    rhash::crc_sum_flags flags;
    rhash::crc_context   state;
    rhash::crc_sums      digest;
+   /** \brief MD4 of Qt is replaced with this one when the state is to be saved. */
+   rhash::md4_ctx       md4state;
   }
   m_Context_rhash;
 #endif
@@ -138,11 +143,32 @@ class CCryptographicHash : public QObject
   QCryptographicHash* m_QtHash;
 #endif
   QByteArray m_Result;
+  /** \brief Hashes large blocks of a tree hash on several threads, NULL if
+      they are hashed by the calling thread alone. */
+  CParallelTth *m_ParallelTth;
  public:
   void reset(const qint64 size = 0);
   void addData(const char *data, int length);
   void addData(const QByteArray &data);
   QByteArray result();
+  /** \brief Returns true if intermediate state may be saved with saveState(). */
+  bool isSerializable(void);
+  /** \brief Switches algorithms computed by Qt to equivalent built-in ones, whose
+      state may be saved, and resets the hash. Returns isSerializable(). */
+  bool makeSerializable(void);
+  /** \brief Returns intermediate state of the hash, or empty array if it may not
+      be saved. The state is valid for the same build of the program only. */
+  QByteArray saveState(void);
+  /** \brief Continues from a state returned by saveState(), returns false if the
+      state belongs to another algorithm or build. */
+  bool restoreState(const QByteArray& state);
+  /** \brief Continues the hash as if a range of data was added, given hash of
+      the range alone and its length. Ranges of a message may so be hashed
+      independently and joined in order. Returns false unless isCombinable(). */
+  bool combine(const QByteArray& rangeHash, const qint64 rangeLength);
+  /** \brief Lets large blocks of a tree hash be split among helper threads,
+      NULL hashes them on the calling thread. The helper is not owned. */
+  void setParallelTth(CParallelTth *tth) { m_ParallelTth = tth; }
   static QByteArray hash(const QByteArray &data, Algorithm method);
   static QByteArray hash(const QString &message, Algorithm method);
  public:
@@ -155,6 +181,8 @@ class CCryptographicHash : public QObject
   static QString description(const Algorithm algorithm);
   /** \brief Returns favorable file extension of for checksum file. */
   static QString extension(const Algorithm algorithm);
+  /** \brief Returns true if hashes of ranges of a message may be combined. */
+  static bool isCombinable(const Algorithm algorithm);
   /** \brief Returns size of a message digest (a hash) in bytes. */
   static int digestSize(const Algorithm algorithm);
   /** \brief Detects hashing algorithm for given message (data) and its digest (hash) */
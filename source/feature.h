@@ -51,5 +51,6 @@
 #define FEATURE_QT_HASH
 #define FEATURE_PREFER_QT_NATIVE_HASH
 //#define FEATURE_AUTOSCROLL
+#define FEATURE_IO_URING
 
 #endif // FEATURE_H
@@ -16,6 +16,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QtCore/QCoreApplication>
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
@@ -44,13 +45,39 @@ CFileHasher::CFileHasher()
  m_HashAlgorithm = CCryptographicHash::Md5;
  setRootPath(QDir::rootPath());
  //
- connect(this,SIGNAL(startWorkerThread(QString,CCryptographicHash::Algorithm)),
-         &m_HashingThread,SLOT(compute(QString,CCryptographicHash::Algorithm)));
- connect(&m_HashingThread,SIGNAL(begin()),this,SLOT(workerThreadStarted()));
- connect(&m_HashingThread,SIGNAL(update()),this,SLOT(workerThreadUpdated()));
- connect(&m_HashingThread,SIGNAL(done()),this,SLOT(workerThreadFinished()));
- //
- //m_HashingThread.start(QThread::LowestPriority);
+ m_WorkerCount = 1;
+ m_JobCpus = 1;
+ setWorkerCount(CHashingTuner::availableCpuCount());
+ m_ReadMode = CFileHashingThread::Buffered;
+ m_UseIoUring = true;
+ m_ScheduleByDevice = true;
+ m_ScheduleLargestFirst = false;
+ m_AutoTune = true;
+ // workers usually keep all CPUs busy already
+ m_ParallelBatch = false;
+ m_SplitFiles = true;
+ m_UseLanes = true;
+ m_UseCheckpoints = true;
+ m_CheckpointDirectory = QDir::homePath()+"/.qfilehasher/checkpoints";
+ m_PlacementMode = CCpuPlacement::Unpinned;
+ m_ThreadPriority = QThread::LowestPriority;
+ m_BlockSize = 0x100000;
+ m_CurrentWorker = -1;
+ m_BytesHashed = 0;
+ setProgressRate(10);
+ connect(&m_ProgressTimer,SIGNAL(timeout()),this,SLOT(sampleProgress()));
+ m_CurrentFileIndex = 0;
+ m_CurrentFileStatus = CFileHasher::Unchecked;
+ m_HashingPaused = false;
+ m_HashingStopped = true;
+ resetCounters();
+}
+
+CFileHasher::~CFileHasher()
+{
+ emit cancelWorkerThread();
+ waitWorkerThreads();
+ qDeleteAll(m_HashingThreads);
 }
 
 QString CFileHasher::toNativeSeparators(QString pathName)
@@ -163,6 +190,17 @@ void CFileHasher::setHashAlgorithm(CCryptographicHash::Algorithm algorithm)
  m_HashAlgorithm = algorithm;
 }
 
+void CFileHasher::setWorkerCount(const int count)
+{
+ m_WorkerCount = qMax(1,count);
+}
+
+void CFileHasher::setProgressRate(const int rate)
+{
+ m_ProgressRate = qBound(1,rate,100);
+ m_ProgressTimer.setInterval(1000/m_ProgressRate);
+}
+
 CByteArrayCodec::Encoding CFileHasher::hashEncoding(void)
 {
  return m_HashEncoding;
@@ -181,6 +219,7 @@ QString CFileHasher::statusName(const CFileHasher::FileStatus status)
   case CFileHasher::NoAccess: return tr("Inaccessible");
   case CFileHasher::HashMatch: return tr("Checked");
   case CFileHasher::HashMismatch: return tr("Hash mismatch");
+  case CFileHasher::Unchecked: return tr("Unchecked");
  }
  return "";
 }
@@ -377,6 +416,44 @@ bool CFileHasher::saveChecksumFile(const QString& fileName)
  return false;
 }
 
+bool CFileHasher::saveBatchChecksumFiles(const QString& fileName)
+{
+ const QList<CCryptographicHash::Algorithm> algorithms = m_HashingQueue.batchAlgorithms();
+ if (algorithms.isEmpty()) return true;
+ QString baseName = fileName;
+ const QString ext = "."+CCryptographicHash::extension(m_HashAlgorithm);
+ if (baseName.endsWith(ext,Qt::CaseInsensitive)) baseName.chop(ext.size());
+ // batch files are generated in place of the main one, which is restored after
+ const CCryptographicHash::Algorithm hashAlgorithm = m_HashAlgorithm;
+ const QList<QByteArray> targetFileHashes = m_TargetFileHashes;
+ const QStringList checksumFile = m_ChecksumFile;
+ bool status = true;
+ for (int i = 0, n = algorithms.count(); i < n; i++)
+ {
+  m_HashAlgorithm = algorithms.at(i);
+  m_TargetFileHashes.clear();
+  for (int j = 0, m = m_TargetFileNames.count(); j < m; j++)
+  {
+   // files of the list that were not hashed in this job have no batch hashes
+   QByteArray fileHash;
+   if ((j < m_CalculatedBatchHashes.count()) && (i < m_CalculatedBatchHashes.at(j).count()))
+   {
+    fileHash = m_CalculatedBatchHashes.at(j).at(i);
+   }
+   m_TargetFileHashes.append(fileHash);
+  }
+  generateChecksumFile();
+  if (!saveChecksumFile(baseName+"."+CCryptographicHash::extension(m_HashAlgorithm)))
+  {
+   status = false;
+ }}
+ m_HashAlgorithm = hashAlgorithm;
+ m_TargetFileHashes = targetFileHashes;
+ encodeFileHashes();
+ m_ChecksumFile = checksumFile;
+ return status;
+}
+
 QString& CFileHasher::generateHtmlReport(void)
 {
  m_Report.clear();
@@ -478,6 +555,7 @@ QString& CFileHasher::generateHtmlReport(void)
      tr("File")));
    for (int i = 0; i < m_CalculatedFileHashes.count()/*sourceFilesCount()*/; i++)
    {
+    if (CFileHasher::Unchecked == calculatedFileStatus(i)) continue;
     m_Report.append(QString("<tr><td>%1</td><td>%2</td><td>%3</td><td>%4</td></tr>\n")
      .arg(QString("%1").arg(i),statusName(calculatedFileStatus(i)),
      calculatedFileHash(i),sourceFilePath(i)));
@@ -493,6 +571,7 @@ QString& CFileHasher::generateHtmlReport(void)
     tr("File")));
    for (int i = 0; i < m_CalculatedFileHashes.count()/*sourceFilesCount()*/; i++)
    {
+    if (CFileHasher::Unchecked == calculatedFileStatus(i)) continue;
     m_Report.append(QString("<tr><td>%1</td><td>%2</td><td>%3</td><td>%4</td>"
      "<td>%5</td></tr>\n").arg(QString("%1").arg(i),statusName(calculatedFileStatus(i)),
      calculatedFileHash(i),sourceFileHash(i),sourceFilePath(i)));
@@ -970,6 +1049,7 @@ void CFileHasher::beforeHashing(void)
  }}
  //
  m_CalculatedFileHashes.clear();
+ m_CalculatedBatchHashes.clear();
  m_FileStatuses.clear();
 }
 
@@ -1055,47 +1135,245 @@ int CFileHasher::currentFileIndex(void)
 
 QString CFileHasher::currentFilePath(void)
 {
- return m_HashingThread.filePath();
+ return sourceFilePath(m_CurrentFileIndex);
 }
 
 qint64 CFileHasher::currentFileSize(void)
 {
- return m_HashingThread.fileSize();
+ if ((m_CurrentFileIndex >= 0) && (m_CurrentFileIndex < m_HashingQueue.count()))
+ {
+  return m_HashingQueue.fileSize(m_CurrentFileIndex);
+ }
+ else return 0;
 }
 
 CFileHasher::FileStatus CFileHasher::currentFileStatus(void)
 {
  return m_CurrentFileStatus;
- //return m_HashingThread.status();
 }
 
 int CFileHasher::currentFileProgress(void)
 {
- return m_HashingThread.progress();
+ if ((m_CurrentWorker >= 0) && (m_CurrentWorker < m_HashingThreads.count()))
+ {
+  return m_HashingThreads.at(m_CurrentWorker)->progress();
+ }
+ else return 0;
 }
 
 int CFileHasher::totalFileProgress(void)
 {
  if (sourceFilesCount() > 0)
  {
-  return (int)(100.0*(m_CurrentFileIndex+1)/sourceFilesCount());
+  return (int)(100.0*(sourceFilesCount()-m_UncheckedCount)/sourceFilesCount());
  }
  else return 0;
 }
 
 
+void CFileHasher::setThreadPriority(const QThread::Priority priority)
+{
+ m_ThreadPriority = priority;
+ // readers take priority of their worker as they start with every file
+ for (int i = 0, n = m_HashingThreads.count(); i < n; i++)
+ {
+  if (m_HashingThreads.at(i)->isRunning()) m_HashingThreads.at(i)->setPriority(priority);
+ }
+}
+
+void CFileHasher::createWorkerThreads(const int count)
+{
+ if (m_HashingThreads.count() == count) return;
+ qDeleteAll(m_HashingThreads);
+ m_HashingThreads.clear();
+ for (int i = 0; i < count; i++)
+ {
+  CFileHashingThread *worker = new CFileHashingThread(&m_HashingQueue,&m_BufferPool,i);
+  // a worker running out of files may finish the job, no need to wait for the timer
+  connect(worker,SIGNAL(finished()),this,SLOT(sampleProgress()));
+  connect(this,SIGNAL(pauseWorkerThread()),worker,SLOT(pause()));
+  connect(this,SIGNAL(resumeWorkerThread()),worker,SLOT(resume()));
+  connect(this,SIGNAL(cancelWorkerThread()),worker,SLOT(cancel()));
+  m_HashingThreads.append(worker);
+ }
+}
+
+void CFileHasher::waitWorkerThreads(void)
+{
+ for (int i = 0, n = m_HashingThreads.count(); i < n; i++)
+ {
+  m_HashingThreads.at(i)->wait();
+ }
+}
+
+void CFileHasher::recordFileResult(const int index)
+{
+ m_CurrentFileIndex = index;
+ QByteArray fileHash;
+ if (CFileHashingQueue::Done == m_HashingQueue.fileState(index))
+ {
+  fileHash = m_HashingQueue.fileHash(index);
+  m_CurrentFileStatus = CFileHasher::Good;
+  if (CFileHasher::Verification == m_OperationMode)
+  {
+   if (m_SourceFileHashes.at(index) == fileHash)
+   {
+    m_CurrentFileStatus = HashMatch;
+   }
+   else
+   {
+    m_CurrentFileStatus = HashMismatch;
+  }}
+ }
+ else
+ {
+  m_CurrentFileStatus = NoAccess;
+ }
+ m_UncheckedCount--;
+ if ((CFileHasher::Good == m_CurrentFileStatus) || (HashMatch == m_CurrentFileStatus))
+ {
+  m_GoodCount++;
+ }
+ else
+ {
+  m_BrokenCount++;
+ }
+ m_CalculatedFileHashes[index] = fileHash;
+ if (!m_HashingQueue.batchAlgorithms().isEmpty())
+ {
+  m_CalculatedBatchHashes[index] = m_HashingQueue.fileBatchHashes(index);
+ }
+ m_FileStatuses[index] = m_CurrentFileStatus;
+}
+
+void CFileHasher::collectFileLists(void)
+{
+ clearFileLists();
+ for (int i = 0, n = m_FileStatuses.count(); i < n; i++)
+ {
+  if (CFileHasher::Unchecked == m_FileStatuses.at(i)) continue;
+  QString filePath = sourceFilePath(i);
+  m_AllFiles.append(filePath);
+  switch (m_FileStatuses.at(i))
+  {
+   case CFileHasher::Good:
+   case CFileHasher::HashMatch:
+   {
+    m_GoodFileIndices.append(i);
+    m_GoodFiles.append(filePath);
+    break;
+   }
+   case CFileHasher::HashMismatch:
+   {
+    m_BrokenFileIndices.append(i);
+    m_BrokenFiles.append(filePath);
+    m_HashMismatchFileIndices.append(i);
+    m_HashMismatchFiles.append(filePath);
+    break;
+   }
+   case CFileHasher::NoAccess:
+   {
+    m_BrokenFileIndices.append(i);
+    m_BrokenFiles.append(filePath);
+    m_NoAccessFileIndices.append(i);
+    m_NoAccessFiles.append(filePath);
+    break;
+   }
+   default: break;
+  }
+ }
+}
+
+
 void CFileHasher::startHashing(void)
 {
+ emit cancelWorkerThread();
+ waitWorkerThreads();
+ // drop notifications left over from the previous run
+ QCoreApplication::removePostedEvents(this,QEvent::MetaCall);
+ //
+ const int n = sourceFilesCount();
  m_CurrentFileIndex = 0;
+ m_CurrentFileStatus = CFileHasher::Unchecked;
  resetCounters();
  clearFileLists();
+ m_CalculatedFileHashes.clear();
+ m_CalculatedBatchHashes.clear();
+ m_FileStatuses.clear();
+ QStringList filePaths;
+ for (int i = 0; i < n; i++)
+ {
+  m_CalculatedFileHashes.append(QByteArray());
+  m_CalculatedBatchHashes.append(QList<QByteArray>());
+  m_FileStatuses.append(CFileHasher::Unchecked);
+  filePaths.append(sourceFilePath(i));
+ }
+ m_HashingPaused = false;
  m_HashingStopped = false;
- m_HashingThread.start(QThread::LowestPriority);
- if (m_HashingPaused) pauseHashing();
- else
+ if (0 == n)
  {
-  emit startWorkerThread(sourceFilePath(m_CurrentFileIndex),m_HashAlgorithm);
+  stopHashing();
+  return;
  }
+ // the tuner never runs more workers than CPUs available to the process,
+ // reserved ones excluded
+ const bool placed = m_Placement.setup(m_PlacementMode,m_WorkerCpus,m_ReservedCpus);
+ int cpus = CHashingTuner::availableCpuCount();
+ if (placed && (m_Placement.cpuCount() > 0)) cpus = qMin(cpus,m_Placement.cpuCount());
+ const int workers = qMin(m_AutoTune ? qMin(m_WorkerCount,cpus) : m_WorkerCount,n);
+ // workers are threads of their own, helpers only take CPUs they leave idle
+ m_JobCpus = cpus;
+ m_HelperPool.setMaxThreadCount(qMax(0,cpus-workers));
+ createWorkerThreads(workers);
+ m_CurrentWorker = -1;
+ m_BytesHashed = 0;
+ m_WorkerBytes.fill(0,workers);
+ m_RecentFileIndices.clear();
+ // when tuned, buffers have room for the largest block size the tuner may try
+ const int bufferSize = (int)(m_AutoTune ? 2*m_BlockSize : m_BlockSize);
+ if (!m_BufferPool.setup(workers*m_HashingThreads.at(0)->bufferCount(),bufferSize))
+ {
+  stopHashing();
+  return;
+ }
+ // batch algorithms make sense for new checksum files only, the main
+ // algorithm is not computed twice
+ QList<CCryptographicHash::Algorithm> batchAlgorithms;
+ if (CFileHasher::Computation == m_OperationMode)
+ {
+  for (int i = 0, count = m_BatchHashAlgorithms.count(); i < count; i++)
+  {
+   const CCryptographicHash::Algorithm algorithm = m_BatchHashAlgorithms.at(i);
+   if ((algorithm != m_HashAlgorithm) && !batchAlgorithms.contains(algorithm))
+   {
+    batchAlgorithms.append(algorithm);
+ }}}
+ m_HashingQueue.setup(filePaths,m_HashAlgorithm,batchAlgorithms,workers,
+                      m_ScheduleByDevice,m_ScheduleLargestFirst);
+ // checkpoints are simply not taken if their directory can not be made
+ CCheckpointStore *checkpoints = (m_UseCheckpoints && m_Checkpoints.setup(m_CheckpointDirectory)) ?
+                                 &m_Checkpoints : NULL;
+ for (int i = 0; i < workers; i++)
+ {
+  m_HashingThreads.at(i)->setBlockSize(m_BlockSize);
+  m_HashingThreads.at(i)->setReadMode(m_ReadMode);
+  m_HashingThreads.at(i)->setUseIoUring(m_UseIoUring);
+  m_HashingThreads.at(i)->setParallelBatch(m_ParallelBatch);
+  m_HashingThreads.at(i)->setSplitFiles(m_SplitFiles);
+  m_HashingThreads.at(i)->setUseLanes(m_UseLanes);
+  m_HashingThreads.at(i)->setCheckpointStore(checkpoints);
+  m_HashingThreads.at(i)->setPlacement(placed ? &m_Placement : NULL);
+  m_HashingThreads.at(i)->setThrottle(&m_Throttle);
+  m_HashingThreads.at(i)->setHelperPool(&m_HelperPool);
+  m_WorkerBytes[i] = m_HashingThreads.at(i)->bytesHashed();
+  m_HashingThreads.at(i)->start(m_ThreadPriority);
+ }
+ if (m_AutoTune)
+ {
+  m_Tuner.setup(workers,(int)m_BlockSize,bufferSize,m_HashingThreads.at(0)->ringDepth());
+  m_TuningClock.start();
+ }
+ m_ProgressTimer.start();
 }
 
 void CFileHasher::pauseHashing(void)
@@ -1104,31 +1382,36 @@ void CFileHasher::pauseHashing(void)
  if (m_HashingPaused)
  {
   m_HashingPaused = false;
-  m_HashingThread.resume();
-  if (0 == m_ProcessingCount)
-  {
-   emit startWorkerThread(sourceFilePath(m_CurrentFileIndex),m_HashAlgorithm);
-  }
+  emit resumeWorkerThread();
  }
  else
  {
   m_HashingPaused = true;
-  m_HashingThread.pause();
+  emit pauseWorkerThread();
  }
 }
 
 void CFileHasher::stopHashing(void)
 {
- //if (m_HashingPaused) pauseHashing();
+ if (m_HashingStopped) return;
  m_HashingPaused = false;
  m_HashingStopped = true;
- m_HashingThread.cancel();
- m_HashingThread.resume();
-}
-
-void CFileHasher::beginFileProcessing(const int index)
-{
- emit startWorkerThread(filePath(m_SourceFileNames.at(index)),m_HashAlgorithm);
+ m_ProgressTimer.stop();
+ emit cancelWorkerThread();
+ waitWorkerThreads();
+ // pick up files finished after the last sample
+ for (int i = 0, n = m_FileStatuses.count(); i < n; i++)
+ {
+  if ((CFileHasher::Unchecked == m_FileStatuses.at(i)) &&
+      (CFileHashingQueue::Pending != m_HashingQueue.fileState(i)))
+  {
+   recordFileResult(i);
+   m_RecentFileIndices.append(i);
+ }}
+ m_ProcessingCount = 0;
+ collectFileLists();
+ emit fileProcessingFinished();
+ m_RecentFileIndices.clear();
 }
 
 void CFileHasher::pauseFileProcessing(void)
@@ -1147,93 +1430,77 @@ void CFileHasher::cancelFileProcessing(void)
 }
 
 
-void CFileHasher::workerThreadStarted(void)
+void CFileHasher::applyTuning(void)
 {
- m_ProcessingCount = 1; //m_ProcessingCount++;
- emit fileProcessingBegan();
-}
-
-void CFileHasher::workerThreadUpdated(void)
-{
- emit fileProcessingUpdated();
+ m_HashingQueue.setWorkerLimit(m_Tuner.workers());
+ m_HelperPool.setMaxThreadCount(qMax(0,m_JobCpus-m_Tuner.workers()));
+ for (int i = 0, n = m_HashingThreads.count(); i < n; i++)
+ {
+  m_HashingThreads.at(i)->tune(m_Tuner.blockSize(),m_Tuner.ringDepth());
+  m_HashingThreads.at(i)->wake();
+ }
 }
 
-void CFileHasher::workerThreadFinished(void)
+void CFileHasher::sampleProgress(void)
 {
- if (m_HashingThread.status())
- {
-  m_CurrentFileStatus = CFileHasher::Good;
- }
- else
+ if (m_HashingStopped) return;
+ // byte counters wrap around, only differences between samples matter
+ const qint64 bytesHashed = m_BytesHashed;
+ for (int i = 0, n = m_HashingThreads.count(); i < n; i++)
  {
-  m_CurrentFileStatus = NoAccess;
-  m_NoAccessFileIndices.append(currentFileIndex());
-  m_NoAccessFiles.append(currentFilePath());
+  const quint32 bytes = m_HashingThreads.at(i)->bytesHashed();
+  m_BytesHashed += (quint32)(bytes-m_WorkerBytes.at(i));
+  m_WorkerBytes[i] = bytes;
  }
- m_AllFiles.append(currentFilePath());
- QByteArray fileHash;
- if (CFileHasher::Good == m_CurrentFileStatus)
+ // results of all files finished since the previous sample are passed at once
+ const int previousFileIndex = m_CurrentFileIndex;
+ const QVector<int> finished = m_HashingQueue.takeFinished();
+ if (m_AutoTune)
  {
-  fileHash = m_HashingThread.fileHash();
-  //
-  switch (m_OperationMode)
+  // time spent paused is not accounted
+  const int elapsed = m_TuningClock.restart();
+  if (!m_HashingPaused &&
+      m_Tuner.sample(m_BytesHashed-bytesHashed,finished.count(),elapsed))
   {
-   case CFileHasher::Computation:
-   case CFileHasher::Updating:
-   {
-    m_UncheckedCount--; m_GoodCount++;
-    m_GoodFileIndices.append(currentFileIndex());
-    m_GoodFiles.append(currentFilePath());
-    break;
-   }
-   case CFileHasher::Verification:
-   {
-    QByteArray savedHash = m_SourceFileHashes.at(m_CurrentFileIndex);
-    if (savedHash == fileHash)
-    {
-     m_UncheckedCount--; m_GoodCount++;
-     m_CurrentFileStatus = HashMatch;
-     m_GoodFileIndices.append(currentFileIndex());
-     m_GoodFiles.append(currentFilePath());
-    }
-    else
-    {
-     m_UncheckedCount--; m_BrokenCount++;
-     m_CurrentFileStatus = HashMismatch;
-     m_BrokenFileIndices.append(currentFileIndex());
-     m_BrokenFiles.append(currentFilePath());
-     m_HashMismatchFileIndices.append(currentFileIndex());
-     m_HashMismatchFiles.append(currentFilePath());
-    }
-    break;
-   }
-  }
+   applyTuning();
+ }}
+ for (int i = 0, n = finished.count(); i < n; i++)
+ {
+  const int index = finished.at(i);
+  if (CFileHasher::Unchecked != m_FileStatuses.at(index)) continue;
+  recordFileResult(index);
+  m_RecentFileIndices.append(index);
  }
- else
+ if (0 == m_UncheckedCount)
  {
-  m_UncheckedCount--; m_BrokenCount++;
-  m_BrokenFileIndices.append(currentFileIndex());
-  m_BrokenFiles.append(currentFilePath());
+  stopHashing();
+  return;
  }
- //
- m_CalculatedFileHashes.append(fileHash);
- m_FileStatuses.append(currentFileStatus());
- //
- if (((m_CurrentFileIndex+1) < m_SourceFileNames.count()) && !m_HashingStopped)
+ // the shown file stays the same until its worker is done with it
+ int fileIndex = -1;
+ if (m_CurrentWorker >= 0) fileIndex = m_HashingThreads.at(m_CurrentWorker)->fileIndex();
+ m_ProcessingCount = 0;
+ for (int i = 0, n = m_HashingThreads.count(); i < n; i++)
  {
-  emit fileProcessingFinished();
-  m_ProcessingCount = 0; //m_ProcessingCount--;
-  m_CurrentFileIndex++;
-  if (!m_HashingPaused)
+  const int index = m_HashingThreads.at(i)->fileIndex();
+  if (index < 0) continue;
+  m_ProcessingCount++;
+  if (fileIndex < 0)
   {
-   emit startWorkerThread(sourceFilePath(m_CurrentFileIndex),m_HashAlgorithm);
-  }
- }
- else
+   fileIndex = index;
+   m_CurrentWorker = i;
+ }}
+ if (!m_RecentFileIndices.isEmpty())
  {
-  stopHashing();
-  m_ProcessingCount = 0;
   emit fileProcessingFinished();
+  m_RecentFileIndices.clear();
  }
+ if (fileIndex >= 0)
+ {
+  m_CurrentFileIndex = fileIndex;
+  m_CurrentFileStatus = CFileHasher::Unchecked;
+  if (fileIndex != previousFileIndex) emit fileProcessingBegan();
+ }
+ emit fileProcessingUpdated();
 }
 
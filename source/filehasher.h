@@ -22,8 +22,12 @@
 #include <QObject>
 #include <QtCore/QDir>
 #include <QtCore/QStringList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTime>
+#include <QtCore/QTimer>
 
 #include "filehashingthread.h"
+#include "hashingtuner.h"
 #include "bytearraycodec.h"
 
 class CFileHasher : public QObject
@@ -32,9 +36,70 @@ class CFileHasher : public QObject
  public:
   enum OperationMode { Computation, Verification, Updating };
   enum UpdateMode { Brief, Deep, Complete, DeltaDeep, DeltaComplete };
-  enum FileStatus { Good, NoAccess, HashMatch, HashMismatch };
+  enum FileStatus { Good, NoAccess, HashMatch, HashMismatch, Unchecked };
  private:
-  CFileHashingThread m_HashingThread;
+  /** \brief Files to process and their results, shared by hashing workers. */
+  CFileHashingQueue m_HashingQueue;
+  /** \brief Read buffers of hashing workers, allocated once per job. */
+  CBufferPool m_BufferPool;
+  /** \brief Pool of hashing workers. */
+  QList<CFileHashingThread*> m_HashingThreads;
+  /** \brief Number of hashing workers to run simultaneously. */
+  int m_WorkerCount;
+  /** \brief Size of a single read from a file. */
+  qint64 m_BlockSize;
+  /** \brief How hashing workers read file contents. */
+  CFileHashingThread::ReadMode m_ReadMode;
+  /** \brief Open and read small files in batches through io_uring. */
+  bool m_UseIoUring;
+  /** \brief Limit concurrent readers per device, one for rotational disks. */
+  bool m_ScheduleByDevice;
+  /** \brief Start with the largest files, results keep the list order. */
+  bool m_ScheduleLargestFirst;
+  /** \brief Adjust block size, read-ahead and active workers to measured throughput. */
+  bool m_AutoTune;
+  /** \brief Compute batch algorithms on threads of their own. */
+  bool m_ParallelBatch;
+  /** \brief Split huge files into chunks hashed by several workers, where
+      hashes of chunks may be combined. */
+  bool m_SplitFiles;
+  /** \brief Hash small files side by side, where the algorithm has a
+      multi-buffer engine for this CPU. */
+  bool m_UseLanes;
+  /** \brief Save progress of large files, so that an interrupted job
+      continues where it stopped. */
+  bool m_UseCheckpoints;
+  QString m_CheckpointDirectory;
+  CCheckpointStore m_Checkpoints;
+  /** \brief Pin workers to CPUs and their buffers to memory nodes. */
+  CCpuPlacement::Mode m_PlacementMode;
+  /** \brief CPU groups of listed placement, such as "0-7;8-15". */
+  QString m_WorkerCpus;
+  /** \brief CPUs kept free for other services, such as "0,1". */
+  QString m_ReservedCpus;
+  CCpuPlacement m_Placement;
+  /** \brief Byte rate, CPU and I/O limits of the job, adjustable while it runs. */
+  CHashingThrottle m_Throttle;
+  /** \brief Threads helping workers with tree hashes, as many as CPUs are
+      left over by active workers of the job. */
+  QThreadPool m_HelperPool;
+  /** \brief CPUs available to the job. */
+  int m_JobCpus;
+  QThread::Priority m_ThreadPriority;
+  CHashingTuner m_Tuner;
+  QTime m_TuningClock;
+  /** \brief Worker whose file is currently shown as being processed. */
+  int m_CurrentWorker;
+  /** \brief Samples progress of hashing workers. */
+  QTimer m_ProgressTimer;
+  /** \brief Progress samples per second. */
+  int m_ProgressRate;
+  /** \brief Bytes hashed during the current job. */
+  qint64 m_BytesHashed;
+  /** \brief Byte counters of workers at the previous sample. */
+  QVector<quint32> m_WorkerBytes;
+  /** \brief Files finished since the previous notification. */
+  QVector<int> m_RecentFileIndices;
   //
   /** \brief Operation mode: Computation, Verification or Updating. */
   CFileHasher::OperationMode m_OperationMode;
@@ -96,6 +161,11 @@ class CFileHasher : public QObject
   //QStringList m_MissingFileHashes;
   /** \brief Selected hashing algorithm. */
   CCryptographicHash::Algorithm m_HashAlgorithm;
+  /** \brief Algorithms computed besides the selected one when computing hashes,
+      each is saved to a checksum file of its own. */
+  QList<CCryptographicHash::Algorithm> m_BatchHashAlgorithms;
+  /** \brief Hashes of batch algorithms for each of m_SourceFileNames items. */
+  QList<QList<QByteArray> > m_CalculatedBatchHashes;
   /** \brief Selected hash representation. */
   CByteArrayCodec::Encoding m_HashEncoding;
   /** \brief Statring (root) directory path, should end with path separator. */
@@ -106,7 +176,7 @@ class CFileHasher : public QObject
   CFileHasher::FileStatus m_CurrentFileStatus;
   /** \brief Counter for unchecked file. */
   int m_UncheckedCount;
-  /** \brief Counter for currently processing files, usually = 1 when working and = 0 when idle. */
+  /** \brief Counter for currently processing files, up to the number of workers when working and = 0 when idle. */
   int m_ProcessingCount;
   /** \brief Counter for successfully processed files. */
   int m_GoodCount;
@@ -119,6 +189,11 @@ class CFileHasher : public QObject
  private:
   QString toNativeSeparators(QString pathName);
   QString getListItem(QStringList& list, const int index);
+  void createWorkerThreads(const int count);
+  void waitWorkerThreads(void);
+  void recordFileResult(const int index);
+  void collectFileLists(void);
+  void applyTuning(void);
  public:
   QString textEncoding(void) { return m_TextEncoding; }
   QString textEncoding(const int index) { return m_TextEncodings.at(index); }
@@ -141,6 +216,39 @@ class CFileHasher : public QObject
   void setRootPath(const QString& path);
   CCryptographicHash::Algorithm hashAlgorithm(void);
   void setHashAlgorithm(CCryptographicHash::Algorithm algorithm);
+  QList<CCryptographicHash::Algorithm>& batchHashAlgorithms(void) { return m_BatchHashAlgorithms; }
+  int workerCount(void) { return m_WorkerCount; }
+  void setWorkerCount(const int count);
+  bool& doUseHugePages(void) { return m_BufferPool.useHugePages(); }
+  bool& doUseIoUring(void) { return m_UseIoUring; }
+  bool& doScheduleByDevice(void) { return m_ScheduleByDevice; }
+  bool& doScheduleLargestFirst(void) { return m_ScheduleLargestFirst; }
+  bool& doAutoTune(void) { return m_AutoTune; }
+  bool& doHashBatchInParallel(void) { return m_ParallelBatch; }
+  bool& doSplitLargeFiles(void) { return m_SplitFiles; }
+  bool& doHashFilesInLanes(void) { return m_UseLanes; }
+  bool& doUseCheckpoints(void) { return m_UseCheckpoints; }
+  QString& checkpointDirectory(void) { return m_CheckpointDirectory; }
+  CCpuPlacement::Mode placementMode(void) { return m_PlacementMode; }
+  void setPlacementMode(const CCpuPlacement::Mode mode) { m_PlacementMode = mode; }
+  QString& workerCpus(void) { return m_WorkerCpus; }
+  QString& reservedCpus(void) { return m_ReservedCpus; }
+  QThread::Priority threadPriority(void) { return m_ThreadPriority; }
+  /** \brief Sets priority of workers, running ones included. */
+  void setThreadPriority(const QThread::Priority priority);
+  /** \brief Bytes per second all workers may hash together, 0 if not limited. */
+  qint64 byteRateLimit(void) { return m_Throttle.byteRate(); }
+  void setByteRateLimit(const qint64 rate) { m_Throttle.setByteRate(rate); }
+  /** \brief Percent of wall time every worker may spend on a CPU. */
+  int dutyCycle(void) { return m_Throttle.dutyCycle(); }
+  void setDutyCycle(const int percent) { m_Throttle.setDutyCycle(percent); }
+  CHashingThrottle::IoClass ioClass(void) { return m_Throttle.ioClass(); }
+  int ioLevel(void) { return m_Throttle.ioLevel(); }
+  void setIoPriority(const CHashingThrottle::IoClass ioClass, const int level) { m_Throttle.setIoPriority(ioClass,level); }
+  CFileHashingThread::ReadMode readMode(void) { return m_ReadMode; }
+  void setReadMode(const CFileHashingThread::ReadMode mode) { m_ReadMode = mode; }
+  int progressRate(void) { return m_ProgressRate; }
+  void setProgressRate(const int rate);
   CByteArrayCodec::Encoding hashEncoding(void);
   void setHashEncoding(CByteArrayCodec::Encoding encoding);
   QString statusName(const CFileHasher::FileStatus status);
@@ -184,6 +292,9 @@ class CFileHasher : public QObject
   void generateMD5file(void);
   void generateChecksumFile(void);
   bool saveChecksumFile(const QString& fileName);
+  /** \brief Saves checksum files of batch algorithms next to the given one,
+      with the extension replaced by the name of each algorithm. */
+  bool saveBatchChecksumFiles(const QString& fileName);
   QString& generateHtmlReport(void);
   QString& htmlReport(void) { return m_Report; }
   bool saveHtmlReport(const QString& fileName);
@@ -224,6 +335,9 @@ class CFileHasher : public QObject
   int totalFileProgress(void);
   int uncheckedFileCount(void) { return m_UncheckedCount; }
   int processingFileCount(void) { return m_ProcessingCount; }
+  /** \brief Files finished since the previous fileProcessingFinished() notification. */
+  const QVector<int>& recentFileIndices(void) { return m_RecentFileIndices; }
+  qint64 bytesHashed(void) { return m_BytesHashed; }
   int goodFileCount(void) { return m_GoodCount; }
   int brokenFileCount(void) { return m_BrokenCount; }
   //
@@ -240,23 +354,19 @@ class CFileHasher : public QObject
   void fileProcessingUpdated(void);
   void fileProcessingFinished(void);
  public slots:
-  void beginFileProcessing(const int index);
   void pauseFileProcessing(void);
   void resumeFileProcessing(void);
   void cancelFileProcessing(void);
   // backend interface //
  signals:
-  void startWorkerThread(const QString& filePath,
-                         const CCryptographicHash::Algorithm hashAlgorithm);
   void pauseWorkerThread(void);
   void resumeWorkerThread(void);
   void cancelWorkerThread(void);
  private slots:
-  void workerThreadStarted(void);
-  void workerThreadUpdated(void);
-  void workerThreadFinished(void);
+  void sampleProgress(void);
  public:
   CFileHasher();
+  ~CFileHasher();
 };
 
 #endif // FILEHASHER_H
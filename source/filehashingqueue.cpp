@@ -0,0 +1,557 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QMutexLocker>
+#include "filehashingqueue.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/sysmacros.h>
+#endif
+
+static bool isRotationalDevice(const quint64 device)
+{
+#ifdef Q_OS_LINUX
+ const QString path = QString("/sys/dev/block/%1:%2")
+  .arg(major((dev_t)device)).arg(minor((dev_t)device));
+ // partitions have no queue of their own, it belongs to the parent disk
+ QFile file(path+"/queue/rotational");
+ if (!file.exists()) file.setFileName(path+"/../queue/rotational");
+ if (file.open(QIODevice::ReadOnly)) return (file.readAll().trimmed() == "1");
+ // network and memory file systems have no block device behind them
+ return false;
+#else
+ Q_UNUSED(device);
+ return false;
+#endif
+}
+
+
+struct larger_file_t
+{
+ const QVector<qint64> *sizes;
+ bool operator()(const int a, const int b) const { return sizes->at(a) > sizes->at(b); }
+};
+
+CFileHashingQueue::CFileHashingQueue()
+{
+ m_HashAlgorithm = CCryptographicHash::Md5;
+ m_SizesKnown = false;
+ m_WorkerLimit = 0;
+ m_Idle = 0;
+ m_Gone = 0;
+ m_NextSplit = 0;
+}
+
+CFileHashingQueue::~CFileHashingQueue()
+{
+ clearLanes();
+ qDeleteAll(m_Splits);
+}
+
+void CFileHashingQueue::clearLanes(void)
+{
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  delete m_Lanes.at(i);
+ }
+ m_Lanes.clear();
+}
+
+void CFileHashingQueue::setup(const QStringList& filePaths,
+                              const CCryptographicHash::Algorithm hashAlgorithm,
+                              const QList<CCryptographicHash::Algorithm>& batchAlgorithms,
+                              const int workerCount, const bool byDevice,
+                              const bool largestFirst)
+{
+ clearLanes();
+ {
+  QMutexLocker locker(&m_SplitMutex);
+  qDeleteAll(m_Splits);
+  m_Splits.clear();
+ }
+ m_FilePaths = filePaths;
+ m_HashAlgorithm = hashAlgorithm;
+ m_BatchAlgorithms = batchAlgorithms;
+ const int n = m_FilePaths.count();
+ {
+  QMutexLocker locker(&m_ResultMutex);
+  m_FileHashes.clear();
+  m_FileHashes.resize(n);
+  m_BatchFileHashes.clear();
+  m_BatchFileHashes.resize(n);
+  m_FileSizes.fill(0,n);
+  m_FileStates.fill(Pending,n);
+  m_FinishedFiles.clear();
+ }
+ const int workers = qMax(1,workerCount);
+ m_WorkerLimit = workers;
+ m_Idle = 0;
+ m_Gone = 0;
+ arrangeFiles(workers,byDevice,largestFirst);
+ if (m_SizesKnown)
+ {
+  QMutexLocker locker(&m_ResultMutex);
+  m_FileSizes = m_ScheduledSizes;
+ }
+ // workers join devices as they ask for files
+ for (int i = 0; i < workers; i++)
+ {
+  lane_t *lane = new lane_t;
+  lane->begin = 0;
+  lane->end = 0;
+  lane->device = -1;
+  m_Lanes.append(lane);
+ }
+}
+
+void CFileHashingQueue::arrangeFiles(const int workerCount, const bool byDevice,
+                                     const bool largestFirst)
+{
+ const int n = m_FilePaths.count();
+ QVector<int> groups(n,0);
+ QVector<bool> rotational(1,false);
+ m_SizesKnown = byDevice || largestFirst;
+ m_ScheduledSizes.fill(0,m_SizesKnown ? n : 0);
+ if (m_SizesKnown)
+ {
+  // files that can not be examined make a group of their own, they fail fast anyway
+  QHash<quint64,int> deviceGroups;
+  rotational.clear();
+  for (int i = 0; i < n; i++)
+  {
+   quint64 device = ~(quint64)0;
+#ifdef Q_OS_UNIX
+   struct stat info;
+   if (0 == stat(QFile::encodeName(m_FilePaths.at(i)).constData(),&info))
+   {
+    m_ScheduledSizes[i] = info.st_size;
+    if (byDevice) device = info.st_dev;
+   }
+#else
+   m_ScheduledSizes[i] = QFileInfo(m_FilePaths.at(i)).size();
+#endif
+   int group = deviceGroups.value(device,-1);
+   if (group < 0)
+   {
+    group = rotational.count();
+    deviceGroups.insert(device,group);
+    rotational.append((~(quint64)0 != device) && isRotationalDevice(device));
+   }
+   groups[i] = group;
+  }
+  if (rotational.isEmpty()) rotational.append(false);
+ }
+ // files of a device keep their relative order unless the largest go first
+ m_Devices.resize(rotational.count());
+ QVector<int> offsets(rotational.count()+1,0);
+ for (int i = 0; i < n; i++)
+ {
+  offsets[groups.at(i)+1]++;
+ }
+ for (int i = 0, count = rotational.count(); i < count; i++)
+ {
+  offsets[i+1] += offsets.at(i);
+  device_t& device = m_Devices[i];
+  device.next = offsets.at(i);
+  device.end = offsets.at(i+1);
+  device.bytes = 0;
+  device.rotational = rotational.at(i);
+  device.depth = device.rotational ? 1 : workerCount;
+  device.active = 0;
+ }
+ m_Order.resize(n);
+ for (int i = 0; i < n; i++)
+ {
+  if (m_SizesKnown) m_Devices[groups.at(i)].bytes += m_ScheduledSizes.at(i);
+  m_Order[offsets[groups.at(i)]++] = i;
+ }
+ if (largestFirst)
+ {
+  for (int i = 0, count = m_Devices.count(); i < count; i++)
+  {
+   larger_file_t larger;
+   larger.sizes = &m_ScheduledSizes;
+   qStableSort(m_Order.begin()+m_Devices.at(i).next,m_Order.begin()+m_Devices.at(i).end,larger);
+ }}
+}
+
+bool CFileHashingQueue::take(const int worker, int& index)
+{
+ lane_t *lane = m_Lanes.at(worker);
+ do
+ {
+  QMutexLocker locker(&lane->mutex);
+  if (lane->begin < lane->end)
+  {
+   index = m_Order.at(lane->begin++);
+   return true;
+  }
+ }
+ while (refill(worker));
+ return false;
+}
+
+bool CFileHashingQueue::takeSmall(const int worker, const qint64 limit, int& index)
+{
+ lane_t *lane = m_Lanes.at(worker);
+ int next;
+ {
+  QMutexLocker locker(&lane->mutex);
+  if (lane->begin >= lane->end) return false;
+  next = m_Order.at(lane->begin);
+ }
+ // the file may have to be examined, that is done without holding the lane;
+ // only the owner moves its front, thieves may have cut the run meanwhile
+ if (!isSmall(next,limit)) return false;
+ QMutexLocker locker(&lane->mutex);
+ if (lane->begin >= lane->end) return false;
+ lane->begin++;
+ index = next;
+ return true;
+}
+
+bool CFileHashingQueue::isSmall(const int index, const qint64 limit)
+{
+ if (m_SizesKnown) return (m_ScheduledSizes.at(index) < limit);
+ // files that can not be examined are not small, the usual path reports them
+#ifdef Q_OS_UNIX
+ struct stat info;
+ if (0 != stat(QFile::encodeName(m_FilePaths.at(index)).constData(),&info)) return false;
+ return S_ISREG(info.st_mode) && (info.st_size < limit);
+#else
+ QFileInfo info(m_FilePaths.at(index));
+ return info.isFile() && (info.size() < limit);
+#endif
+}
+
+bool CFileHashingQueue::refill(const int worker)
+{
+ QMutexLocker locker(&m_DeviceMutex);
+ lane_t *lane = m_Lanes.at(worker);
+ // a worker over the limit gives its device up, so others may take its place
+ if (parked(worker))
+ {
+  if (lane->device >= 0) leaveDevice(lane);
+  return false;
+ }
+ for (;;)
+ {
+  // stay on the same device while it has files left, it keeps disk access local
+  if (lane->device >= 0)
+  {
+   device_t& device = m_Devices[lane->device];
+   if (device.next < device.end)
+   {
+    // runs shrink as the device drains, so its workers finish close together;
+    // with sizes known runs are measured in bytes, a large file makes a run alone
+    int end = device.next;
+    if (m_SizesKnown)
+    {
+     const qint64 target = device.bytes/(2*device.depth);
+     qint64 bytes = 0;
+     do
+     {
+      bytes += m_ScheduledSizes.at(m_Order.at(end++));
+     }
+     while ((end < device.end) && (bytes < target));
+     device.bytes -= bytes;
+    }
+    else
+    {
+     end += qMax(1,(device.end-device.next)/(2*device.depth));
+    }
+    QMutexLocker laneLocker(&lane->mutex);
+    lane->begin = device.next;
+    lane->end = device.next = end;
+    return true;
+   }
+   if (steal(worker)) return true;
+   leaveDevice(lane);
+  }
+  // join the least busy device that still has files and admits one more worker
+  int best = -1;
+  for (int i = 0, n = m_Devices.count(); i < n; i++)
+  {
+   const device_t& device = m_Devices.at(i);
+   if ((device.active >= device.depth) || !hasFiles(i)) continue;
+   if ((best < 0) || (device.active < m_Devices.at(best).active)) best = i;
+  }
+  if (best < 0) return false;
+  m_Devices[best].active++;
+  lane->device = best;
+ }
+}
+
+bool CFileHashingQueue::hasFiles(const int device)
+{
+ if (m_Devices.at(device).next < m_Devices.at(device).end) return true;
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  lane_t *lane = m_Lanes.at(i);
+  if (lane->device != device) continue;
+  QMutexLocker locker(&lane->mutex);
+  if (lane->begin < lane->end) return true;
+ }
+ return false;
+}
+
+void CFileHashingQueue::leaveDevice(lane_t *lane)
+{
+ m_Devices[lane->device].active--;
+ lane->device = -1;
+ m_DeviceFreed.wakeAll();
+}
+
+bool CFileHashingQueue::waitForDevice(const int worker, const QAtomicInt& cancelled)
+{
+ QMutexLocker locker(&m_DeviceMutex);
+ // a worker over the limit waits as a parked one instead
+ if (cancelled || parked(worker)) return !cancelled;
+ bool files = false;
+ for (int i = 0, n = m_Devices.count(); i < n; i++)
+ {
+  if (!hasFiles(i)) continue;
+  // one was given up since the worker last looked
+  if (m_Devices.at(i).active < m_Devices.at(i).depth) return true;
+  files = true;
+ }
+ // with no files left the worker still waits for chunks while others hash
+ // files that may yet be split; the last one out wakes the rest to leave
+ const int workers = qMin((int)m_WorkerLimit,m_Lanes.count());
+ if (!files && ((int)m_Idle+m_Gone+1 >= workers))
+ {
+  m_Gone++;
+  m_DeviceFreed.wakeAll();
+  return false;
+ }
+ m_Idle.ref();
+ m_DeviceFreed.wait(&m_DeviceMutex);
+ m_Idle.deref();
+ return !cancelled;
+}
+
+void CFileHashingQueue::wakeWaiting(void)
+{
+ QMutexLocker locker(&m_DeviceMutex);
+ m_DeviceFreed.wakeAll();
+}
+
+bool CFileHashingQueue::steal(const int worker)
+{
+ const int device = m_Lanes.at(worker)->device;
+ for (;;)
+ {
+  int victim = -1, remaining = 0;
+  for (int i = 0, n = m_Lanes.count(); i < n; i++)
+  {
+   lane_t *lane = m_Lanes.at(i);
+   if ((i == worker) || (lane->device != device)) continue;
+   QMutexLocker locker(&lane->mutex);
+   if ((lane->end - lane->begin) > remaining)
+   {
+    remaining = lane->end - lane->begin;
+    victim = i;
+  }}
+  if (victim < 0) return false;
+  int begin, end;
+  {
+   lane_t *lane = m_Lanes.at(victim);
+   QMutexLocker locker(&lane->mutex);
+   remaining = lane->end - lane->begin;
+   // victim might have been emptied in the meantime, look again
+   if (remaining <= 0) continue;
+   end = lane->end;
+   begin = end - (remaining+1)/2;
+   lane->end = begin;
+  }
+  lane_t *lane = m_Lanes.at(worker);
+  QMutexLocker locker(&lane->mutex);
+  lane->begin = begin;
+  lane->end = end;
+  return true;
+ }
+}
+
+void CFileHashingQueue::setFileSize(const int index, const qint64 size)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ m_FileSizes[index] = size;
+}
+
+qint64 CFileHashingQueue::fileSize(const int index)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ return m_FileSizes.at(index);
+}
+
+QByteArray CFileHashingQueue::fileHash(const int index)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ return m_FileHashes.at(index);
+}
+
+QList<QByteArray> CFileHashingQueue::fileBatchHashes(const int index)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ return m_BatchFileHashes.at(index);
+}
+
+CFileHashingQueue::FileState CFileHashingQueue::fileState(const int index)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ return (CFileHashingQueue::FileState)m_FileStates.at(index);
+}
+
+void CFileHashingQueue::setFileResults(const QVector<CFileHashingQueue::result_t>& results)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ for (int i = 0, n = results.count(); i < n; i++)
+ {
+  const result_t& result = results.at(i);
+  m_FileSizes[result.index] = result.size;
+  m_FileHashes[result.index] = result.hash;
+  m_BatchFileHashes[result.index] = result.batchHashes;
+  m_FileStates[result.index] = result.status ? Done : Failed;
+  m_FinishedFiles.append(result.index);
+ }
+}
+
+QVector<int> CFileHashingQueue::takeFinished(void)
+{
+ QMutexLocker locker(&m_ResultMutex);
+ QVector<int> result = m_FinishedFiles;
+ m_FinishedFiles.clear();
+ return result;
+}
+
+int CFileHashingQueue::split(const int worker, const QString& path, const qint64 offset,
+                             const qint64 size)
+{
+ // a lane's device is only changed by its own worker
+ const int device = m_Lanes.at(worker)->device;
+ if ((m_Lanes.count() < 2) || (size-offset < 2*ChunkSize) ||
+     ((device >= 0) && m_Devices.at(device).rotational))
+ {
+  return -1;
+ }
+ {
+  // busy workers would only take chunks away from their own files, unless
+  // none are left on the device for them once they are done
+  QMutexLocker locker(&m_DeviceMutex);
+  if ((0 == m_Idle) && (device >= 0) && hasFiles(device)) return -1;
+ }
+ split_t *split = new split_t;
+ split->path = path;
+ split->base = offset;
+ split->size = size;
+ split->next = 0;
+ split->count = (int)((size-offset+ChunkSize-1)/ChunkSize);
+ split->finished = 0;
+ split->failed = false;
+ split->hashes.resize(split->count);
+ int id;
+ {
+  QMutexLocker locker(&m_SplitMutex);
+  split->id = id = m_NextSplit++;
+  m_Splits.append(split);
+ }
+ // workers waiting for a busy device may help with chunks meanwhile
+ wakeWaiting();
+ return id;
+}
+
+CFileHashingQueue::split_t* CFileHashingQueue::findSplit(const int split)
+{
+ for (int i = 0, n = m_Splits.count(); i < n; i++)
+ {
+  if (m_Splits.at(i)->id == split) return m_Splits.at(i);
+ }
+ return NULL;
+}
+
+bool CFileHashingQueue::takeChunk(const int split, CFileHashingQueue::chunk_t& chunk)
+{
+ QMutexLocker locker(&m_SplitMutex);
+ // helpers join the split with most chunks left
+ split_t *source = NULL;
+ for (int i = 0, n = m_Splits.count(); i < n; i++)
+ {
+  split_t *candidate = m_Splits.at(i);
+  if (((split >= 0) && (candidate->id != split)) || candidate->failed ||
+      (candidate->next >= candidate->count))
+  {
+   continue;
+  }
+  if ((NULL == source) || (candidate->count-candidate->next > source->count-source->next))
+  {
+   source = candidate;
+ }}
+ if (NULL == source) return false;
+ chunk.split = source->id;
+ chunk.chunk = source->next++;
+ chunk.path = source->path;
+ chunk.offset = source->base+chunk.chunk*ChunkSize;
+ chunk.length = qMin((qint64)ChunkSize,source->size-chunk.offset);
+ return true;
+}
+
+void CFileHashingQueue::finishChunk(const CFileHashingQueue::chunk_t& chunk,
+                                    const QByteArray& hash, const bool status)
+{
+ QMutexLocker locker(&m_SplitMutex);
+ split_t *split = findSplit(chunk.split);
+ if (NULL == split) return;
+ split->hashes[chunk.chunk] = hash;
+ split->finished++;
+ if (!status) split->failed = true;
+ m_ChunkFinished.wakeAll();
+}
+
+bool CFileHashingQueue::waitChunks(const int split, const unsigned long msecs,
+                                   int& finished, int& count)
+{
+ QMutexLocker locker(&m_SplitMutex);
+ split_t *source = findSplit(split);
+ if (NULL == source) return true;
+ if (!source->failed && (source->finished < source->count))
+ {
+  m_ChunkFinished.wait(&m_SplitMutex,msecs);
+ }
+ finished = source->finished;
+ count = source->count;
+ return source->failed || (source->finished == source->count);
+}
+
+bool CFileHashingQueue::endSplit(const int split, QVector<QByteArray>& hashes)
+{
+ QMutexLocker locker(&m_SplitMutex);
+ split_t *source = findSplit(split);
+ if (NULL == source) return false;
+ m_Splits.removeAll(source);
+ const bool status = !source->failed && (source->finished == source->count);
+ if (status) hashes = source->hashes;
+ delete source;
+ return status;
+}
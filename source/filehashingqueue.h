@@ -0,0 +1,209 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEHASHINGQUEUE_H
+#define FILEHASHINGQUEUE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+#include "cryptohash.h"
+
+/** \brief Shared job state of a pool of hashing workers.
+
+    Files are grouped by the device they reside on. Every device admits a
+    limited number of workers at once: a single one for rotational disks,
+    where parallel readers only make heads seek, and all of them otherwise.
+    A worker takes a run of consecutive files of its device and sticks to
+    that device while it has files left. A worker that finds the device
+    drained steals the back half of the largest run of another worker on the
+    same device. Results are stored by file index, so the order in which
+    workers finish does not affect the order of results.
+
+    A huge file of an algorithm whose hashes of ranges may be combined, or
+    the rest of it, is split into chunks when workers are idle, or when it is
+    the last file of its device. Its worker hashes chunks one after another, workers that run
+    out of files take chunks of it too, and the worker combines hashes of all
+    chunks in order when they are done. Workers out of files therefore stay
+    until every worker is out of them. */
+class CFileHashingQueue
+{
+ private:
+  struct lane_t
+  {
+   QMutex mutex;
+   int begin;
+   int end;
+   int device;
+  };
+  struct split_t
+  {
+   int id;
+   QString path;
+   qint64 base;
+   qint64 size;
+   int next;
+   int count;
+   int finished;
+   bool failed;
+   QVector<QByteArray> hashes;
+  };
+  struct device_t
+  {
+   int next;
+   int end;
+   qint64 bytes;
+   int depth;
+   int active;
+   bool rotational;
+  };
+  QVector<lane_t*> m_Lanes;
+  QVector<device_t> m_Devices;
+  /** \brief File indices grouped by device, lanes and devices refer to ranges of it. */
+  QVector<int> m_Order;
+  /** \brief File sizes taken when the job was set up, if examined at all. */
+  QVector<qint64> m_ScheduledSizes;
+  bool m_SizesKnown;
+  /** \brief Workers with higher numbers do not take new files. */
+  QAtomicInt m_WorkerLimit;
+  /** \brief Guards device state and lane ownership. */
+  QMutex m_DeviceMutex;
+  /** \brief Signalled when a worker gives a device up or may take other work. */
+  QWaitCondition m_DeviceFreed;
+  /** \brief Workers waiting for files or chunks, changed with the device
+      mutex held, and workers gone for good. */
+  QAtomicInt m_Idle;
+  int m_Gone;
+  QStringList m_FilePaths;
+  CCryptographicHash::Algorithm m_HashAlgorithm;
+  /** \brief Algorithms computed in the same pass besides the main one. */
+  QList<CCryptographicHash::Algorithm> m_BatchAlgorithms;
+  QMutex m_ResultMutex;
+  QVector<QByteArray> m_FileHashes;
+  QVector<QList<QByteArray> > m_BatchFileHashes;
+  QVector<qint64> m_FileSizes;
+  QVector<char> m_FileStates;
+  QVector<int> m_FinishedFiles;
+  /** \brief Files being hashed in chunks, guarded by their own mutex. */
+  QList<split_t*> m_Splits;
+  int m_NextSplit;
+  QMutex m_SplitMutex;
+  QWaitCondition m_ChunkFinished;
+  split_t* findSplit(const int split);
+  bool refill(const int worker);
+  bool steal(const int worker);
+  void leaveDevice(lane_t *lane);
+  void clearLanes(void);
+  bool hasFiles(const int device);
+  void arrangeFiles(const int workerCount, const bool byDevice, const bool largestFirst);
+ public:
+  enum FileState { Pending, Done, Failed };
+  /** \brief Size of chunks of a split file, files with less than two chunks
+      left are not split. */
+  static const qint64 ChunkSize = Q_INT64_C(0x4000000);
+  struct chunk_t
+  {
+   int split;
+   int chunk;
+   QString path;
+   qint64 offset;
+   qint64 length;
+  };
+  struct result_t
+  {
+   int index;
+   qint64 size;
+   QByteArray hash;
+   /** \brief Hashes of batch algorithms in the order they were given. */
+   QList<QByteArray> batchHashes;
+   bool status;
+  };
+  /** \brief Prepares a new job.
+
+      Files may be grouped by device, and the largest files of each device
+      may be put first, so that a huge file found late in the list does not
+      keep a single worker busy after the others are done. Batch algorithms
+      are computed from the same data as the main one, every file is read
+      once however many hashes it gets. */
+  void setup(const QStringList& filePaths,
+             const CCryptographicHash::Algorithm hashAlgorithm,
+             const QList<CCryptographicHash::Algorithm>& batchAlgorithms,
+             const int workerCount, const bool byDevice,
+             const bool largestFirst);
+  /** \brief Takes next file for given worker, returns false if no files left. */
+  bool take(const int worker, int& index);
+  /** \brief Takes next file of the worker's current run if it is smaller than
+      given limit, returns false otherwise. Never moves the worker to other
+      files, what it does not take stays in its run for thieves. */
+  bool takeSmall(const int worker, const qint64 limit, int& index);
+  /** \brief Tells whether a file is known to be smaller than given limit, by
+      its size taken at setup or by the file system if sizes were not taken. */
+  bool isSmall(const int index, const qint64 limit);
+  /** \brief Waits while files are left only on devices that admit no more
+      workers, or while other workers still hash files that may be split.
+      Returns true when the worker should look for files or chunks again,
+      false once all workers are out of files or the worker is cancelled. */
+  bool waitForDevice(const int worker, const QAtomicInt& cancelled);
+  /** \brief Wakes workers waiting for a device, so that they notice new
+      chunks, a new limit or cancellation. */
+  void wakeWaiting(void);
+  void setWorkerLimit(const int limit) { m_WorkerLimit.fetchAndStoreOrdered(limit); }
+  /** \brief A parked worker takes no files until the limit is raised. */
+  bool parked(const int worker) { return (worker >= m_WorkerLimit); }
+  int count(void) { return m_FilePaths.count(); }
+  int workerCount(void) { return m_Lanes.count(); }
+  int deviceCount(void) { return m_Devices.count(); }
+  CCryptographicHash::Algorithm hashAlgorithm(void) { return m_HashAlgorithm; }
+  const QList<CCryptographicHash::Algorithm>& batchAlgorithms(void) { return m_BatchAlgorithms; }
+  QString filePath(const int index) { return m_FilePaths.at(index); }
+  void setFileSize(const int index, const qint64 size);
+  /** \brief Stores results of several files at once. */
+  void setFileResults(const QVector<CFileHashingQueue::result_t>& results);
+  qint64 fileSize(const int index);
+  QByteArray fileHash(const int index);
+  QList<QByteArray> fileBatchHashes(const int index);
+  CFileHashingQueue::FileState fileState(const int index);
+  /** \brief Takes indices of files finished since the previous call. */
+  QVector<int> takeFinished(void);
+  /** \brief Splits the rest of a file taken by given worker, from given
+      offset on, into chunks. Returns id of the split or -1 if the rest is
+      better read as a whole. A file is split only if other workers are idle,
+      or no other file is left on its device for them to take. Files of
+      rotational disks are not split, seeking would cost more than it gains. */
+  int split(const int worker, const QString& path, const qint64 offset, const qint64 size);
+  /** \brief Tells cheaply whether some workers wait for files or chunks. */
+  bool hasIdle(void) { return (m_Idle > 0); }
+  /** \brief Takes a chunk of given split, or of any split if -1 is given. */
+  bool takeChunk(const int split, CFileHashingQueue::chunk_t& chunk);
+  /** \brief Stores hash of a chunk, status false fails the whole split. */
+  void finishChunk(const CFileHashingQueue::chunk_t& chunk, const QByteArray& hash,
+                   const bool status);
+  /** \brief Waits up to given time for chunks of a split to finish, returns
+      true when all of them are finished or the split failed. */
+  bool waitChunks(const int split, const unsigned long msecs, int& finished, int& count);
+  /** \brief Removes a split, chunks still taken are dropped when finished.
+      Returns hashes of all chunks in order, unless the split failed or is
+      not finished. */
+  bool endSplit(const int split, QVector<QByteArray>& hashes);
+  CFileHashingQueue();
+  ~CFileHashingQueue();
+};
+
+#endif // FILEHASHINGQUEUE_H
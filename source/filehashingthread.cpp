@@ -17,98 +17,938 @@
 */
 
 #include <QtCore/QFile>
-#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
 #include "filehashingthread.h"
+#include "paralleltth.h"
 
-CFileHashingThread::CFileHashingThread()
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// checkpoints are taken and accepted at offsets any read mode may seek to
+static const qint64 CheckpointAlignment = 0x10000;
+
+static void adviseSequentialAccess(uchar *address, const qint64 size)
 {
+#ifdef Q_OS_UNIX
+ const quintptr page = (quintptr)sysconf(_SC_PAGESIZE);
+ const quintptr begin = (quintptr)address & ~(page-1);
+ madvise((void *)begin,(size_t)((quintptr)address+size-begin),MADV_SEQUENTIAL);
+#else
+ Q_UNUSED(address); Q_UNUSED(size);
+#endif
+}
+
+// touching mapped pages past the end of a file that was cut short raises
+// SIGBUS, which would end the whole application rather than fail the file
+static bool coversMapping(QFile& file, const qint64 end)
+{
+#ifdef Q_OS_UNIX
+ struct stat info;
+ return (0 == fstat(file.handle(),&info)) && ((qint64)info.st_size >= end);
+#else
+ // Windows refuses to truncate a file that has a mapped view
+ Q_UNUSED(file); Q_UNUSED(end);
+ return true;
+#endif
+}
+
+CFileHashingThread::CFileHashingThread(CFileHashingQueue *queue, CBufferPool *pool, const int worker)
+{
+ m_Queue = queue;
+ m_BufferPool = pool;
+ m_Worker = worker;
+ m_Buffer = NULL;
  m_BlockSize = 0x100000;
+ m_RingDepth = 4;
+ m_TunedBlockSize = (int)m_BlockSize;
+ m_TunedRingDepth = m_RingDepth;
+ m_ReadMode = CFileHashingThread::Buffered;
+ m_MapThreshold = 0x800000;
+ m_MapWindowSize = 0x4000000;
+ m_UseIoUring = false;
+ m_UseLanes = true;
+ m_Lanes = 0;
+ m_SmallFileSize = 0x4000;
+ m_BatchSize = 0;
+ m_ResultBatchSize = 64;
  m_HashFunction = NULL;
- m_Paused = false;
- m_Cancelled = false;
+ m_BatchHashFunction = NULL;
+ m_HelperPool = NULL;
+ m_ParallelTth = NULL;
+ m_ParallelBatch = false;
+ m_RangeHash = NULL;
+ m_SplitFiles = true;
+ m_Splittable = false;
+ m_Checkpoints = NULL;
+ m_Placement = NULL;
+ m_Throttle = NULL;
+ m_IoGeneration = -1;
+ m_UseCheckpoints = false;
+ m_CheckpointThreshold = Q_INT64_C(0x40000000);
+ m_CheckpointInterval = Q_INT64_C(0x40000000);
+ m_Checkpointing = false;
+ m_FilePosition = 0;
+ m_LastCheckpoint = 0;
+ m_Reader = new CFileReadingThread(&m_Ring);
+ m_FileSize = 0;
+ m_FileProgress = 0;
+ m_FileIndex = -1;
+ m_BytesHashed = 0;
+ m_Paused = 0;
+ m_Cancelled = 0;
  m_FileStatus = true;
 }
 
-void CFileHashingThread::compute(const QString& filePath, const CCryptographicHash::Algorithm hashType)
+CFileHashingThread::~CFileHashingThread()
 {
- if (NULL == m_HashFunction)
- {
-  m_FilePath = filePath;
-  m_FileInfo.setFile(m_FilePath);
-  m_HashFunction = new CCryptographicHash(hashType,m_FileInfo.size());
- }
- m_Paused = false; m_Cancelled = false;
+ delete m_Reader;
 }
 
 void CFileHashingThread::pause(void)
 {
- m_Paused = true;
+ QMutexLocker locker(&m_StateMutex);
+ m_Paused.fetchAndStoreOrdered(1);
 }
 
 void CFileHashingThread::resume(void)
 {
- m_Paused = false;
+ QMutexLocker locker(&m_StateMutex);
+ m_Paused.fetchAndStoreOrdered(0);
+ m_StateChanged.wakeAll();
 }
 
 void CFileHashingThread::cancel(void)
 {
  if (isRunning())
  {
-  m_Cancelled = true;
-  m_Paused = false;
+  QMutexLocker locker(&m_StateMutex);
+  m_Cancelled.fetchAndStoreOrdered(1);
+  m_Paused.fetchAndStoreOrdered(0);
+  m_StateChanged.wakeAll();
+  // a worker held back by the throttle notices cancellation right away
+  if (m_Throttle) m_Throttle->wakeAll();
+  // so does one waiting for a device held by another worker
+  m_Queue->wakeWaiting();
+ }
+}
+
+void CFileHashingThread::setBlockSize(const qint64 size)
+{
+ m_BlockSize = size;
+ m_TunedBlockSize = (int)size;
+}
+
+void CFileHashingThread::tune(const int blockSize, const int ringDepth)
+{
+ m_TunedBlockSize.fetchAndStoreOrdered(blockSize);
+ m_TunedRingDepth.fetchAndStoreOrdered(ringDepth);
+}
+
+void CFileHashingThread::wake(void)
+{
+ {
+  QMutexLocker locker(&m_StateMutex);
+  m_StateChanged.wakeAll();
+ }
+ // a worker waiting for a device may have been parked meanwhile
+ m_Queue->wakeWaiting();
+}
+
+void CFileHashingThread::applyTuning(void)
+{
+ // new values are picked up between files, a file is read with the same blocks
+ const qint64 blockSize = qBound((qint64)0x1000,(qint64)(int)m_TunedBlockSize,
+                                 (qint64)m_BufferPool->bufferSize());
+ const int ringDepth = qBound(1,(int)m_TunedRingDepth,m_Blocks.count());
+ if ((blockSize == m_BlockSize) && (ringDepth == m_Ring.blocks().count())) return;
+ m_BlockSize = blockSize;
+ QVector<char*> blocks;
+ for (int i = 0; i < ringDepth; i++)
+ {
+  blocks.append(m_Blocks.at(i));
  }
+ m_Ring.setup(blocks,(int)m_BlockSize);
+}
+
+bool CFileHashingThread::waitWhileParked(void)
+{
+ if (!m_Queue->parked(m_Worker)) return false;
+ publishResults();
+ QMutexLocker locker(&m_StateMutex);
+ while (m_Queue->parked(m_Worker) && !m_Cancelled)
+ {
+  m_StateChanged.wait(&m_StateMutex);
+ }
+ return !m_Cancelled;
+}
+
+bool CFileHashingThread::waitWhilePaused(void)
+{
+ // flags are checked without locking for every block,
+ // the mutex is only taken to go to sleep
+ if (m_Paused)
+ {
+  publishResults();
+  // a paused job may well be followed by a reboot
+  if (m_Checkpointing) saveCheckpoint();
+  QMutexLocker locker(&m_StateMutex);
+  while (m_Paused && !m_Cancelled)
+  {
+   m_StateChanged.wait(&m_StateMutex);
+ }}
+ return !m_Cancelled;
 }
 
 void CFileHashingThread::run(void)
 {
+ // the reader and lanes are started from here later and run on the same CPUs
+ if (m_Placement) m_Placement->apply(m_Worker);
+ m_IoGeneration = -1;
+ m_Pace.started = false;
+ if (m_Throttle) m_Throttle->applyIoPriority(m_IoGeneration);
+ // buffers are taken once and reused for every file of the job
+ m_Buffer = m_BufferPool->acquire();
+ for (int i = 0; i < m_RingDepth; i++)
+ {
+  m_Blocks.append(m_BufferPool->acquire());
+ }
+ const int node = m_Placement ? m_Placement->workerNode(m_Worker) : -1;
+ if (node >= 0)
+ {
+  CCpuPlacement::bindMemory(m_Buffer,m_BufferPool->bufferSize(),node);
+  for (int i = 0; i < m_Blocks.count(); i++)
+  {
+   CCpuPlacement::bindMemory(m_Blocks.at(i),m_BufferPool->bufferSize(),node);
+ }}
+ m_Ring.setup(m_Blocks,(int)m_BlockSize);
+ // a single hashing context is reset for every file
+ m_HashFunction = new CCryptographicHash(m_Queue->hashAlgorithm());
+ m_BatchMethods.clear();
+ const QList<CCryptographicHash::Algorithm>& batchAlgorithms = m_Queue->batchAlgorithms();
+ if (!batchAlgorithms.isEmpty())
+ {
+  // both classes name their algorithms alike, unlike their enumerations
+  m_BatchHashFunction = new CCryptographicMultiHash();
+  for (int i = 0, n = batchAlgorithms.count(); i < n; i++)
+  {
+   m_BatchMethods.append(CCryptographicMultiHash::algorithm(
+                          CCryptographicHash::name(batchAlgorithms.at(i))));
+   m_BatchHashFunction->enableMethod(m_BatchMethods.last());
+  }
+  m_BatchHashFunction->setParallel(m_ParallelBatch);
+ }
+ // blocks of a tree hash are split among helpers placed and paced with the worker
+#if defined(FEATURE_LIB_RHASH) && defined(FEATURE_LIB_RHASH_TTH)
+ if (m_HelperPool && (CCryptographicHash::Tth == m_Queue->hashAlgorithm()))
+ {
+  m_ParallelTth = new CParallelTth(m_HelperPool,m_Placement,m_Worker,
+                                   m_Throttle ? &m_Pace : NULL);
+  m_HashFunction->setParallelTth(m_ParallelTth);
+ }
+#endif
+ // state of batch algorithms is not saved, neither is that of Qt hashes
+ m_UseCheckpoints = (NULL != m_Checkpoints) && m_BatchMethods.isEmpty() &&
+                    m_HashFunction->makeSerializable();
+ // chunks carry the main algorithm only
+ if (m_BatchMethods.isEmpty() && CCryptographicHash::isCombinable(m_Queue->hashAlgorithm()))
+ {
+  m_RangeHash = new CCryptographicHash(m_Queue->hashAlgorithm());
+ }
+ // small files are batched into slots of the worker's own buffer, to be read
+ // through io_uring or hashed side by side, with lanes even without io_uring;
+ // batches hold files smaller than a slot only, larger ones are left to be
+ // stolen. Direct mode is not batched since both ways read through page cache
+ m_Lanes = m_UseLanes ? CMultiBufferHash::lanes(m_Queue->hashAlgorithm()) : 0;
+ m_BatchSize = qMin(64,m_BufferPool->bufferSize()/m_SmallFileSize);
+ if ((CFileHashingThread::Direct == m_ReadMode) || (m_BatchSize < 2) ||
+     ((!m_UseIoUring || !m_Uring.setup(m_BatchSize)) && (0 == m_Lanes)))
+ {
+  m_BatchSize = 0;
+ }
+ int index;
  while (!m_Cancelled)
  {
-  while (m_Paused)
+  if (!m_Queue->take(m_Worker,index))
+  {
+   // a worker out of files helps with huge files of others before it leaves
+   if (!m_Queue->parked(m_Worker) && helpWithChunks()) continue;
+   // a worker beyond the tuned limit waits until it is needed again
+   if (waitWhileParked()) continue;
+   // files may be left on devices busy with other workers, such as a
+   // rotational disk, and files others still hash may yet be split; the
+   // worker leaves only when all workers are out of files
+   if (m_Queue->waitForDevice(m_Worker,m_Cancelled)) continue;
+   break;
+  }
+  if (!waitWhilePaused()) break;
+  applyTuning();
+  if (m_BatchSize > 0) hashFileBatch(index);
+  else hashFile(index);
+ }
+ publishResults();
+ m_Uring.release();
+ delete m_HashFunction;
+ m_HashFunction = NULL;
+#if defined(FEATURE_LIB_RHASH) && defined(FEATURE_LIB_RHASH_TTH)
+ delete m_ParallelTth;
+ m_ParallelTth = NULL;
+#endif
+ delete m_RangeHash;
+ m_RangeHash = NULL;
+ delete m_BatchHashFunction;
+ m_BatchHashFunction = NULL;
+ for (int i = 0; i < m_Blocks.count(); i++)
+ {
+  m_BufferPool->release(m_Blocks.at(i));
+ }
+ m_Blocks.clear();
+ m_Ring.setup(QVector<char*>(),0);
+ m_BufferPool->release(m_Buffer);
+ m_Buffer = NULL;
+ m_Paused.fetchAndStoreOrdered(0);
+ m_Cancelled.fetchAndStoreOrdered(0);
+}
+
+void CFileHashingThread::hashFile(const int index)
+{
+ m_FilePath = m_Queue->filePath(index);
+ m_FileProgress = 0;
+#ifdef Q_OS_UNIX
+ if ((CFileHashingThread::Direct == m_ReadMode) && hashFileDirectly(index)) return;
+#endif
+ QFile file(m_FilePath);
+ // data is read straight into pool buffers, bypassing QFile's own buffer
+ if (file.open(QIODevice::ReadOnly|QIODevice::Unbuffered))
+ {
+  beginFile(index,file.size());
+  // the queue splits files only where other workers are or will be idle,
+  // a file read as a whole may still have its rest split once they are
+  m_Splittable = m_SplitFiles && (NULL != m_RangeHash) && !file.isSequential();
+  const int split = m_Splittable ?
+                    m_Queue->split(m_Worker,m_FilePath,m_FilePosition,m_FileSize) : -1;
+  if (split >= 0)
   {
-   msleep(100);
+   m_FileStatus = readRanges(file,split,m_FilePosition);
   }
-  if (NULL != m_HashFunction)
+  // small files and pipes or devices are not worth or not possible to map
+  else if ((CFileHashingThread::Mapped == m_ReadMode) &&
+      (m_FileSize >= m_MapThreshold) && !file.isSequential())
   {
-   QFile file(m_FilePath);
-   if (file.open(QIODevice::ReadOnly))
-   {
-    m_FileSize = file.size();
-    emit begin();
-    while (!m_Cancelled)
-    {
-     while (m_Paused)
-     {
-      msleep(100);
-     }
-     m_HashFunction->addData(file.read(m_BlockSize));
-     m_FileProgress = (int)(100.0*file.pos()/file.size());
-     emit update();
-     if (file.pos() == file.size()) break;
-    }
-    file.close();
-    m_FileHash = m_HashFunction->result();
-    m_FileStatus = true;
-   }
-   else
-   {
-    m_FileStatus = false;
-   }
-   delete m_HashFunction;
-   m_HashFunction = NULL;
-   emit done();
+   m_FileStatus = readMapped(file);
   }
-#if QT_VERSION >= 0x040500
-  yieldCurrentThread();
-#else
+  // there is nothing to overlap for a file that fits in a single block
+  else if (m_FileSize > m_BlockSize)
+  {
+   m_FileStatus = readPipelined(file);
+  }
+  else
+  {
+   m_FileStatus = readSequentially(file);
+  }
+  m_Splittable = false;
+  file.close();
+  finishFile(index);
+ }
+ else
+ {
+  m_FileSize = 0;
+  m_FileStatus = false;
+  addResult(index,QByteArray());
+ }
+}
+
+void CFileHashingThread::hashFileBatch(const int index)
+{
+ // a batch holds small files only and ends at the first larger one, which
+ // stays in the run where idle workers may steal it along with the rest
+ if (!m_Queue->isSmall(index,m_SmallFileSize))
+ {
+  hashFile(index);
+  return;
+ }
+ QVector<int> indices;
+ indices.append(index);
+ int next;
+ while ((indices.count() < m_BatchSize) && m_Queue->takeSmall(m_Worker,m_SmallFileSize,next))
+ {
+  indices.append(next);
+ }
+ const int n = indices.count();
+ QVector<int> lengths(n,-1);
+ if (m_Uring.isValid()) readBatch(indices,lengths);
+ else readBatchSequentially(indices,lengths);
+ if (m_Lanes > 0)
+ {
+  hashBatchLanes(indices,lengths);
+ }
+ else
+ {
+  for (int i = 0; i < n; i++)
+  {
+   if (lengths.at(i) < 0) continue;
+   m_FilePath = m_Queue->filePath(indices.at(i));
+   m_FileProgress = 0;
+   beginFile(indices.at(i),lengths.at(i));
+   hashBlock(m_Buffer+i*m_SmallFileSize,lengths.at(i));
+   m_FileProgress = 100;
+   m_FileStatus = true;
+   finishFile(indices.at(i));
+ }}
+ // failed, larger and not regular files take the usual path, which also
+ // takes care of reporting files that could not be opened
+ for (int i = 0; i < n; i++)
+ {
+  if (lengths.at(i) >= 0) continue;
+  if (!waitWhilePaused()) return;
+  hashFile(indices.at(i));
+ }
+ publishResults();
+}
+
+void CFileHashingThread::readBatch(const QVector<int>& indices, QVector<int>& lengths)
+{
+ const int n = indices.count();
+ QVector<QByteArray> paths(n);
+ QVector<int> descriptors(n,-1);
+ // the whole batch is opened with a single system call, it is known to hold
+ // small files only, so no large file is read twice
+ for (int i = 0; i < n; i++)
+ {
+  paths[i] = QFile::encodeName(m_Queue->filePath(indices.at(i)));
+  m_Uring.prepareOpen(paths.at(i).constData(),i);
+ }
+ bool status = m_Uring.submit();
+ quint64 tag;
+ int result;
+ while (status && m_Uring.complete(tag,result))
+ {
+  descriptors[(int)tag] = result;
+ }
+ // and read with another one, each file into its own slot
+ for (int i = 0; status && (i < n); i++)
+ {
+  if (descriptors.at(i) >= 0)
+  {
+   m_Uring.prepareRead(descriptors.at(i),m_Buffer+i*m_SmallFileSize,m_SmallFileSize,i);
+ }}
+ if (status) status = m_Uring.submit();
+ while (status && m_Uring.complete(tag,result))
+ {
+  // a filled slot means that file has grown since, it is hashed the usual way
+  if ((result < 0) || (result >= m_SmallFileSize) || m_Cancelled) continue;
+  lengths[(int)tag] = result;
+ }
+#ifdef Q_OS_UNIX
+ for (int i = 0; i < n; i++)
+ {
+  if (descriptors.at(i) >= 0) ::close(descriptors.at(i));
+ }
+#endif
+ // requests might still be in flight after a failure, the ring is not reused
+ if (!status) m_Uring.release();
+}
+
+void CFileHashingThread::readBatchSequentially(const QVector<int>& indices, QVector<int>& lengths)
+{
+ for (int i = 0, n = indices.count(); (i < n) && !m_Cancelled; i++)
+ {
+  // files were small when the batch was taken, one grown since is left out
+  QFile file(m_Queue->filePath(indices.at(i)));
+  if (!file.open(QIODevice::ReadOnly|QIODevice::Unbuffered) || file.isSequential() ||
+      (file.size() >= m_SmallFileSize)) continue;
+  char *slot = m_Buffer+i*m_SmallFileSize;
+  qint64 length = 0;
+  qint64 count = 0;
+  while ((length < m_SmallFileSize) && ((count = file.read(slot+length,m_SmallFileSize-length)) > 0))
+  {
+   length += count;
+  }
+  // a file grown meanwhile is hashed the usual way as well
+  if ((count >= 0) && (length < m_SmallFileSize)) lengths[i] = (int)length;
+ }
+}
+
+void CFileHashingThread::hashBatchLanes(const QVector<int>& indices, const QVector<int>& lengths)
+{
+ QVector<const char*> data;
+ QVector<int> sizes;
+ QVector<int> positions;
+ int bytes = 0;
+ for (int i = 0, n = indices.count(); i < n; i++)
+ {
+  if (lengths.at(i) < 0) continue;
+  data.append(m_Buffer+i*m_SmallFileSize);
+  sizes.append(lengths.at(i));
+  positions.append(i);
+  bytes += lengths.at(i);
+ }
+ if (data.isEmpty()) return;
+ if (m_Throttle)
+ {
+  m_Throttle->acquire(bytes,m_Cancelled);
+  m_Throttle->applyIoPriority(m_IoGeneration);
+ }
+ QVector<QByteArray> hashes;
+ CMultiBufferHash::hash(m_Queue->hashAlgorithm(),data,sizes,hashes);
+ m_BytesHashed.fetchAndAddRelaxed(bytes);
+ for (int k = 0, n = positions.count(); k < n; k++)
+ {
+  const int index = indices.at(positions.at(k));
+  m_FilePath = m_Queue->filePath(index);
+  m_FileProgress = 0;
+  beginFile(index,sizes.at(k));
+  // batch algorithms still see each file on its own
+  if (m_BatchHashFunction) m_BatchHashFunction->addData(data.at(k),sizes.at(k));
+  m_FileProgress = 100;
+  m_FileStatus = true;
+  finishFile(index,hashes.at(k));
+ }
+ if (m_Throttle) m_Throttle->pace(m_Pace,m_Cancelled);
+}
+
+void CFileHashingThread::beginFile(const int index, const qint64 size)
+{
+ m_FileSize = size;
+ // size of a small file is published along with its hash
+ if (m_FileSize > m_BlockSize) m_Queue->setFileSize(index,m_FileSize);
+ m_HashFunction->reset(m_FileSize);
+ if (m_BatchHashFunction) m_BatchHashFunction->reset(m_FileSize);
+ m_FilePosition = 0;
+ m_LastCheckpoint = 0;
+ m_Checkpointing = m_UseCheckpoints && (m_FileSize >= m_CheckpointThreshold) &&
+                   CCheckpointStore::identify(m_FilePath,m_FileIdentity) &&
+                   (m_FileIdentity.size == m_FileSize);
+ if (m_Checkpointing) resumeFile();
+ m_FileIndex = index;
+}
+
+void CFileHashingThread::finishFile(const int index, const QByteArray& laneHash)
+{
+ QByteArray fileHash;
+ QList<QByteArray> batchHashes;
+ if (m_FileStatus)
+ {
+  fileHash = laneHash.isEmpty() ? m_HashFunction->result() : laneHash;
+  for (int i = 0, n = m_BatchMethods.count(); i < n; i++)
+  {
+   batchHashes.append(m_BatchHashFunction->result(m_BatchMethods.at(i)));
+ }}
+ m_FileIndex = -1;
+ // a cancelled file is left unprocessed rather than reported with a partial hash,
+ // the next run continues from where this one stopped
+ if (m_Cancelled)
+ {
+  if (m_Checkpointing) saveCheckpoint();
+  m_Checkpointing = false;
+  return;
+ }
+ // a failed file keeps its checkpoint, the part hashed so far is still good
+ if (m_Checkpointing && m_FileStatus)
+ {
+  m_Checkpoints->remove(m_FilePath,CCryptographicHash::name(m_Queue->hashAlgorithm()));
+ }
+ // pausing between files saves no checkpoint of the file just finished
+ m_Checkpointing = false;
+ addResult(index,fileHash,batchHashes);
+}
+
+void CFileHashingThread::addResult(const int index, const QByteArray& hash,
+                                   const QList<QByteArray>& batchHashes)
+{
+ CFileHashingQueue::result_t result;
+ result.index = index;
+ result.size = m_FileSize;
+ result.hash = hash;
+ result.batchHashes = batchHashes;
+ result.status = m_FileStatus;
+ m_Results.append(result);
+ // results of small files are handed over in batches, a large file
+ // takes long enough to be reported on its own
+ if ((m_FileSize > m_BlockSize) || (m_Results.count() >= m_ResultBatchSize))
+ {
+  publishResults();
+ }
+}
+
+void CFileHashingThread::publishResults(void)
+{
+ if (m_Results.isEmpty()) return;
+ m_Queue->setFileResults(m_Results);
+ m_Results.clear();
+}
+
+void CFileHashingThread::hashBlock(const char *data, const int length)
+{
+ // read-ahead is bounded, so holding the hashing back holds the reads back too
+ if (m_Throttle)
+ {
+  m_Throttle->acquire(length,m_Cancelled);
+  m_Throttle->applyIoPriority(m_IoGeneration);
+ }
+ m_HashFunction->addData(data,length);
+ if (m_BatchHashFunction) m_BatchHashFunction->addData(data,length);
+ m_BytesHashed.fetchAndAddRelaxed(length);
+ m_FilePosition += length;
+ if (m_Checkpointing && (m_FilePosition-m_LastCheckpoint >= m_CheckpointInterval))
+ {
+  saveCheckpoint();
+ }
+ if (m_Throttle) m_Throttle->pace(m_Pace,m_Cancelled);
+}
+
+void CFileHashingThread::hashRangeBlock(const char *data, const int length)
+{
+ if (m_Throttle)
+ {
+  m_Throttle->acquire(length,m_Cancelled);
+  m_Throttle->applyIoPriority(m_IoGeneration);
+ }
+ m_RangeHash->addData(data,length);
+ m_BytesHashed.fetchAndAddRelaxed(length);
+ if (m_Throttle) m_Throttle->pace(m_Pace,m_Cancelled);
+}
+
+bool CFileHashingThread::readRange(QFile& file, const CFileHashingQueue::chunk_t& chunk,
+                                   QByteArray& hash)
+{
+ m_RangeHash->reset();
+ // a chunk is read the way a whole file of its size would be
+ bool status;
+ if ((CFileHashingThread::Mapped == m_ReadMode) && (chunk.length >= m_MapThreshold))
+ {
+  status = readRangeMapped(file,chunk);
+ }
+ else
+ {
+  status = readRangePipelined(file,chunk);
+ }
+ if (!status || m_Cancelled) return false;
+ hash = m_RangeHash->result();
+ return true;
+}
+
+bool CFileHashingThread::readRangePipelined(QFile& file, const CFileHashingQueue::chunk_t& chunk)
+{
+ if (!file.seek(chunk.offset)) return false;
+ m_Ring.reset();
+ m_Reader->setFile(&file,chunk.offset+chunk.length);
+ m_Reader->setThrottle(m_Throttle);
+ m_Reader->start(priority());
+ bool status = true;
+ const char *block;
+ int length;
+ while (NULL != (block = m_Ring.acquireFull(length)))
+ {
+  if (!waitWhilePaused())
+  {
+   m_Ring.abort();
+   status = false;
+   break;
+  }
+  hashRangeBlock(block,length);
+  m_Ring.release();
+ }
+ m_Reader->wait();
+ return status && !m_Ring.failed();
+}
+
+bool CFileHashingThread::readRangeMapped(QFile& file, const CFileHashingQueue::chunk_t& chunk)
+{
+ if (!coversMapping(file,chunk.offset+chunk.length)) return false;
+ uchar *window = file.map(chunk.offset,chunk.length);
+ if (NULL == window) return readRangePipelined(file,chunk);
+ adviseSequentialAccess(window,chunk.length);
+ bool status = true;
+ for (qint64 offset = 0; offset < chunk.length; )
+ {
+  const int length = (int)qMin(m_BlockSize,chunk.length-offset);
+  if (!waitWhilePaused() || !coversMapping(file,chunk.offset+offset+length))
+  {
+   status = false;
+   break;
+  }
+  hashRangeBlock((const char *)window+offset,length);
+  offset += length;
+ }
+ file.unmap(window);
+ return status;
+}
+
+bool CFileHashingThread::readRanges(QFile& file, const int split, const qint64 base)
+{
+ // chunks finish in any order, a split file saves no checkpoints; one saved
+ // before still holds for the part hashed so far, until the file is done
+ const bool checkpointing = m_Checkpointing;
+ m_Checkpointing = false;
+ CFileHashingQueue::chunk_t chunk;
+ int finished = 0, count = 1;
+ // a cancelled owner fails the split, so helpers drop its chunks
+ while (waitWhilePaused() && m_Queue->takeChunk(split,chunk))
+ {
+  QByteArray hash;
+  const bool status = readRange(file,chunk,hash);
+  m_Queue->finishChunk(chunk,hash,status);
+  if (!status) break;
+  m_Queue->waitChunks(split,0,finished,count);
+  m_FileProgress = rangesProgress(base,finished);
+ }
+ // chunks taken by helpers may still be hashed, or held by a pause
+ while (waitWhilePaused() && !m_Queue->waitChunks(split,100,finished,count))
+ {
+  m_FileProgress = rangesProgress(base,finished);
+ }
+ QVector<QByteArray> hashes;
+ if (!m_Queue->endSplit(split,hashes) || m_Cancelled) return false;
+ for (int i = 0, n = hashes.count(); i < n; i++)
+ {
+  const qint64 offset = base+i*CFileHashingQueue::ChunkSize;
+  const qint64 length = qMin((qint64)CFileHashingQueue::ChunkSize,m_FileSize-offset);
+  if (!m_HashFunction->combine(hashes.at(i),length)) return false;
+ }
+ m_Checkpointing = checkpointing;
+ m_FileProgress = 100;
+ return true;
+}
+
+int CFileHashingThread::rangesProgress(const qint64 base, const int finished)
+{
+ const qint64 done = qMin(m_FileSize,base+finished*CFileHashingQueue::ChunkSize);
+ return (int)(100.0*done/m_FileSize);
+}
+
+bool CFileHashingThread::helpWithChunks(void)
+{
+ if (NULL == m_RangeHash) return false;
+ CFileHashingQueue::chunk_t chunk;
+ bool helped = false;
+ while (!m_Cancelled && m_Queue->takeChunk(-1,chunk))
+ {
+  helped = true;
+  QByteArray hash;
+  bool status = waitWhilePaused();
+  if (status)
+  {
+   QFile file(chunk.path);
+   status = file.open(QIODevice::ReadOnly|QIODevice::Unbuffered) &&
+            readRange(file,chunk,hash);
+  }
+  m_Queue->finishChunk(chunk,hash,status);
+ }
+ return helped;
+}
+
+void CFileHashingThread::resumeFile(void)
+{
+ qint64 offset;
+ QByteArray state;
+ if (!m_Checkpoints->load(m_FilePath,CCryptographicHash::name(m_Queue->hashAlgorithm()),
+                          m_FileIdentity,offset,state))
+ {
+  return;
+ }
+ if ((0 != offset%CheckpointAlignment) || !m_HashFunction->restoreState(state))
+ {
+  m_HashFunction->reset(m_FileSize);
+  return;
+ }
+ m_FilePosition = m_LastCheckpoint = offset;
+ m_FileProgress = (int)(100.0*m_FilePosition/m_FileSize);
+}
+
+void CFileHashingThread::saveCheckpoint(void)
+{
+ // an unaligned position, after a short read, waits for the next block
+ if ((m_FilePosition == m_LastCheckpoint) || (0 != m_FilePosition%CheckpointAlignment))
+ {
+  return;
+ }
+ m_Checkpoints->save(m_FilePath,CCryptographicHash::name(m_Queue->hashAlgorithm()),
+                     m_FileIdentity,m_FilePosition,m_HashFunction->saveState());
+ m_LastCheckpoint = m_FilePosition;
+}
+
 #ifdef Q_OS_UNIX
-  sched_yield();
+int CFileHashingThread::openDirectly(bool& cached)
+{
+ const QByteArray path = QFile::encodeName(m_FilePath);
+ int noAtime = 0, direct = 0;
+#ifdef O_NOATIME
+ noAtime = O_NOATIME;
 #endif
-#ifdef Q_OS_WINDOWS
-  SwitchToThread();
+#ifdef O_DIRECT
+ direct = O_DIRECT;
+#endif
+ for (;;)
+ {
+  const int fd = ::open(path.constData(),O_RDONLY|noAtime|direct);
+  if (fd >= 0)
+  {
+   cached = (0 == direct);
+   return fd;
+  }
+  // O_NOATIME is only permitted to the owner of the file
+  if ((EPERM == errno) && (0 != noAtime)) noAtime = 0;
+  // O_DIRECT is not supported by some file systems (tmpfs, fuse, ...)
+  else if ((EINVAL == errno) && (0 != direct)) direct = 0;
+  else if (EINTR != errno) return -1;
+ }
+}
+
+bool CFileHashingThread::hashFileDirectly(const int index)
+{
+ bool cached = false;
+ const int fd = openDirectly(cached);
+ if (fd < 0) return false;
+ struct stat info;
+ // pipes and devices are left to the buffered path
+ if ((0 != fstat(fd,&info)) || !S_ISREG(info.st_mode))
+ {
+  ::close(fd);
+  return false;
+ }
+ beginFile(index,(qint64)info.st_size);
+ m_FileStatus = readDirectly(fd,cached);
+ ::close(fd);
+ finishFile(index);
+ return true;
+}
+
+bool CFileHashingThread::readDirectly(const int fd, const bool cached)
+{
+ qint64 position = m_FilePosition;
+ if ((position > 0) && (lseek(fd,(off_t)position,SEEK_SET) < 0)) return false;
+ while (!m_Cancelled)
+ {
+  if (!waitWhilePaused()) break;
+  // pool buffers are page aligned and block size is a multiple of page size,
+  // which satisfies alignment requirements of O_DIRECT
+  const ssize_t length = ::read(fd,m_Buffer,(size_t)m_BlockSize);
+  if (length < 0)
+  {
+   if (EINTR == errno) continue;
+   return false;
+  }
+  if (0 == length) return (position >= m_FileSize);
+  hashBlock(m_Buffer,(int)length);
+#ifdef POSIX_FADV_DONTNEED
+  // without O_DIRECT data passes through page cache, drop it behind us
+  if (cached) posix_fadvise(fd,(off_t)position,(off_t)length,POSIX_FADV_DONTNEED);
 #endif
+  position += length;
+  if (m_FileSize > 0) m_FileProgress = (int)(100.0*qMin(position,m_FileSize)/m_FileSize);
+  // a short direct read means end of file, another read would be misaligned
+  if (!cached && (length < m_BlockSize)) return (position >= m_FileSize);
+ }
+ return true;
+}
 #endif
+
+bool CFileHashingThread::readSequentially(QFile& file)
+{
+ if ((m_FilePosition > 0) && !file.seek(m_FilePosition)) return false;
+ while (!m_Cancelled)
+ {
+  if (!waitWhilePaused()) break;
+  const qint64 length = file.read(m_Buffer,m_BlockSize);
+  if (length < 0) return false;
+  if ((0 == length) && (file.pos() < m_FileSize)) return false;
+  hashBlock(m_Buffer,(int)length);
+  if (m_FileSize > 0) m_FileProgress = (int)(100.0*file.pos()/m_FileSize);
+  if (file.pos() >= m_FileSize) break;
  }
- m_Paused = false;
- m_Cancelled = false;
+ return true;
 }
 
+bool CFileHashingThread::readPipelined(QFile& file)
+{
+ if ((m_FilePosition > 0) && !file.seek(m_FilePosition)) return false;
+ m_Ring.reset();
+ m_Reader->setFile(&file);
+ m_Reader->setThrottle(m_Throttle);
+ m_Reader->start(priority());
+ qint64 position = m_FilePosition;
+ int split = -1;
+ const char *block;
+ int length;
+ while (NULL != (block = m_Ring.acquireFull(length)))
+ {
+  if (!waitWhilePaused())
+  {
+   m_Ring.abort();
+   break;
+  }
+  hashBlock(block,length);
+  m_Ring.release();
+  position += length;
+  m_FileProgress = (int)(100.0*position/m_FileSize);
+  // blocks read ahead past the split are read again as part of a chunk
+  if ((split = splitRest(position)) >= 0)
+  {
+   m_Ring.abort();
+   break;
+  }
+ }
+ m_Reader->wait();
+ if (split >= 0) return readRanges(file,split,position);
+ return !m_Ring.failed();
+}
+
+bool CFileHashingThread::readMapped(QFile& file)
+{
+ const qint64 start = m_FilePosition;
+ qint64 position = start;
+ while (!m_Cancelled && (position < m_FileSize))
+ {
+  const qint64 windowSize = qMin(m_MapWindowSize,m_FileSize-position);
+  // a file that shrank since it was opened fails, as a short read would
+  if (!coversMapping(file,position+windowSize)) return false;
+  uchar *window = file.map(position,windowSize);
+  if (NULL == window)
+  {
+   // mapping is not supported for this file at all, read it instead
+   if (start == position) return readPipelined(file);
+   return false;
+  }
+  adviseSequentialAccess(window,windowSize);
+  for (qint64 offset = 0; !m_Cancelled && (offset < windowSize); )
+  {
+   if (!waitWhilePaused()) break;
+   const int length = (int)qMin(m_BlockSize,windowSize-offset);
+   // checked again for every block, a truncation between this check and
+   // the block being hashed still raises SIGBUS
+   if (!coversMapping(file,position+offset+length))
+   {
+    file.unmap(window);
+    return false;
+   }
+   hashBlock((const char *)window+offset,length);
+   offset += length;
+   m_FileProgress = (int)(100.0*(position+offset)/m_FileSize);
+   const int split = splitRest(position+offset);
+   if (split >= 0)
+   {
+    file.unmap(window);
+    return readRanges(file,split,position+offset);
+   }
+  }
+  file.unmap(window);
+  position += windowSize;
+ }
+ return true;
+}
+
+int CFileHashingThread::splitRest(const qint64 position)
+{
+ // idle workers are peeked at without locking, the queue decides for good
+ if (!m_Splittable || !m_Queue->hasIdle() ||
+     (m_FileSize-position < 2*CFileHashingQueue::ChunkSize))
+ {
+  return -1;
+ }
+ return m_Queue->split(m_Worker,m_FilePath,position,m_FileSize);
+}
@@ -19,43 +19,204 @@
 #ifndef FILEHASHINGTHREAD_H
 #define FILEHASHINGTHREAD_H
 
-#include <QtCore/QFileInfo>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
 #include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include "blockring.h"
+#include "bufferpool.h"
+#include "checkpointstore.h"
+#include "cpuplacement.h"
 #include "cryptohash.h"
+#include "filehashingqueue.h"
+#include "filereadingthread.h"
+#include "hashingthrottle.h"
+#include "iouring.h"
+#include "multibufferhash.h"
+#include "multihash.h"
+
+class CParallelTth;
+class QThreadPool;
 
 class CFileHashingThread : public QThread
 {
  Q_OBJECT
+ public:
+  /** \brief Way of reading files.
+
+      Direct mode bypasses page cache where the file system allows it and
+      drops cached pages behind the reader otherwise; access times of files
+      are preserved where permitted. Other systems read such files buffered. */
+  enum ReadMode { Buffered, Mapped, Direct };
  private:
+  CFileHashingQueue *m_Queue;
+  CBufferPool *m_BufferPool;
+  /** \brief CPUs and memory node of the worker, NULL if not placed. */
+  CCpuPlacement *m_Placement;
+  /** \brief Limits of a background job, NULL if not limited. */
+  CHashingThrottle *m_Throttle;
+  CHashingThrottle::pace_t m_Pace;
+  int m_IoGeneration;
+  int m_Worker;
+  char *m_Buffer;
   CCryptographicHash *m_HashFunction;
-  QFileInfo m_FileInfo;
-  QByteArray m_FileHash;
+  /** \brief Computes batch algorithms of the job, if any, from the same data. */
+  CCryptographicMultiHash *m_BatchHashFunction;
+  QList<CCryptographicMultiHash::Algorithm> m_BatchMethods;
+  bool m_ParallelBatch;
+  /** \brief Threads of the job that help with tree hashes, NULL if none. */
+  QThreadPool *m_HelperPool;
+  CParallelTth *m_ParallelTth;
+  /** \brief Hashes chunks of split files, NULL if hashes of the job may not be combined. */
+  CCryptographicHash *m_RangeHash;
+  bool m_SplitFiles;
+  /** \brief The rest of the current file may be split when workers turn idle. */
+  bool m_Splittable;
+  /** \brief Keeps state of large files for later runs, NULL if not used. */
+  CCheckpointStore *m_Checkpoints;
+  bool m_UseCheckpoints;
+  qint64 m_CheckpointThreshold;
+  qint64 m_CheckpointInterval;
+  /** \brief Current file saves checkpoints. */
+  bool m_Checkpointing;
+  CCheckpointStore::identity_t m_FileIdentity;
+  /** \brief Bytes of current file hashed so far, including those of a checkpoint. */
+  qint64 m_FilePosition;
+  qint64 m_LastCheckpoint;
+  /** \brief Read-ahead blocks taken from the pool, the ring may use fewer of them. */
+  QVector<char*> m_Blocks;
+  CBlockRing m_Ring;
+  CFileReadingThread *m_Reader;
+  CIoUring m_Uring;
   QString m_FilePath;
   qint64 m_FileSize;
   qint64 m_BlockSize;
-  int m_FileProgress;
-  bool m_Cancelled;
-  bool m_Paused;
+  int m_RingDepth;
+  QAtomicInt m_TunedBlockSize;
+  QAtomicInt m_TunedRingDepth;
+  CFileHashingThread::ReadMode m_ReadMode;
+  qint64 m_MapThreshold;
+  qint64 m_MapWindowSize;
+  bool m_UseIoUring;
+  bool m_UseLanes;
+  /** \brief Small files of a batch hashed side by side, 0 if they are hashed one by one. */
+  int m_Lanes;
+  int m_SmallFileSize;
+  int m_BatchSize;
+  /** \brief Results not yet handed over to the queue. */
+  QVector<CFileHashingQueue::result_t> m_Results;
+  int m_ResultBatchSize;
+  QAtomicInt m_FileIndex;
+  QAtomicInt m_FileProgress;
+  QAtomicInt m_BytesHashed;
+  QAtomicInt m_Cancelled;
+  QAtomicInt m_Paused;
+  QMutex m_StateMutex;
+  QWaitCondition m_StateChanged;
   bool m_FileStatus;
- signals:
-  void begin(void);
-  void update(void);
-  void done(void);
+  /** \brief Sleeps while paused, returns false if cancelled. */
+  bool waitWhilePaused(void);
+  /** \brief Sleeps while the worker is parked, returns false if not parked or cancelled. */
+  bool waitWhileParked(void);
+  void applyTuning(void);
+  void hashFile(const int index);
+  void hashFileBatch(const int index);
+  /** \brief Reads small files of a batch into slots of the buffer, lengths of
+      files left for the usual path stay -1. */
+  void readBatch(const QVector<int>& indices, QVector<int>& lengths);
+  void readBatchSequentially(const QVector<int>& indices, QVector<int>& lengths);
+  /** \brief Hashes small files read into slots side by side. */
+  void hashBatchLanes(const QVector<int>& indices, const QVector<int>& lengths);
+  void beginFile(const int index, const qint64 size);
+  /** \brief Reports the file, with its hash computed by lanes if given, or
+      by the worker's own context otherwise. */
+  void finishFile(const int index, const QByteArray& laneHash = QByteArray());
+  void hashBlock(const char *data, const int length);
+  /** \brief Continues current file from its checkpoint, if there is a valid one. */
+  void resumeFile(void);
+  void saveCheckpoint(void);
+  void addResult(const int index, const QByteArray& hash,
+                 const QList<QByteArray>& batchHashes = QList<QByteArray>());
+  void publishResults(void);
+#ifdef Q_OS_UNIX
+  int openDirectly(bool& cached);
+  bool hashFileDirectly(const int index);
+  bool readDirectly(const int fd, const bool cached);
+#endif
+  bool readSequentially(QFile& file);
+  bool readPipelined(QFile& file);
+  /** \brief Hashes a file through windows mapped into memory. Its size is
+      checked before every block, yet a file truncated while a block is being
+      hashed still raises SIGBUS. */
+  bool readMapped(QFile& file);
+  /** \brief Hashes chunks of a split file, waits for chunks taken by helpers
+      and combines hashes of all of them with the part before given offset. */
+  bool readRanges(QFile& file, const int split, const qint64 base);
+  /** \brief Splits the rest of the current file from given offset on if other
+      workers are idle, returns id of the split or -1. */
+  int splitRest(const qint64 position);
+  int rangesProgress(const qint64 base, const int finished);
+  /** \brief Hashes a chunk through the block ring, or mapped in mapped mode. */
+  bool readRange(QFile& file, const CFileHashingQueue::chunk_t& chunk, QByteArray& hash);
+  bool readRangePipelined(QFile& file, const CFileHashingQueue::chunk_t& chunk);
+  bool readRangeMapped(QFile& file, const CFileHashingQueue::chunk_t& chunk);
+  void hashRangeBlock(const char *data, const int length);
+  /** \brief Hashes chunks of files split by other workers, returns false if there were none. */
+  bool helpWithChunks(void);
  public slots:
-  void compute(const QString& filePath, const CCryptographicHash::Algorithm hashType);
   void pause(void);
   void resume(void);
   void cancel(void);
  public:
+  int worker(void) { return m_Worker; }
+  /** \brief Number of pool buffers taken by the worker while it runs. */
+  int bufferCount(void) { return m_RingDepth+1; }
+  qint64 blockSize(void) { return m_BlockSize; }
+  void setBlockSize(const qint64 size);
+  /** \brief Read-ahead blocks a worker takes from the pool, the most it may be tuned to. */
+  int ringDepth(void) { return m_RingDepth; }
+  /** \brief Changes block size and read-ahead depth, takes effect from the next file. */
+  void tune(const int blockSize, const int ringDepth);
+  /** \brief Makes a parked worker check whether it is needed again. */
+  void wake(void);
+  CFileHashingThread::ReadMode readMode(void) { return m_ReadMode; }
+  void setReadMode(const CFileHashingThread::ReadMode mode) { m_ReadMode = mode; }
+  /** \brief Opens and reads small files in batches through io_uring where available. */
+  void setUseIoUring(const bool use) { m_UseIoUring = use; }
+  /** \brief Hashes small files side by side through a multi-buffer engine,
+      where the algorithm has one for this CPU. */
+  void setUseLanes(const bool use) { m_UseLanes = use; }
+  /** \brief Computes batch algorithms on threads of their own, alongside the main one. */
+  void setParallelBatch(const bool parallel) { m_ParallelBatch = parallel; }
+  /** \brief Splits huge files of combinable algorithms, so that idle workers help with them. */
+  void setSplitFiles(const bool split) { m_SplitFiles = split; }
+  /** \brief Saves periodic checkpoints of large files, and continues files
+      from their checkpoints. NULL turns checkpoints off. */
+  void setCheckpointStore(CCheckpointStore *store) { m_Checkpoints = store; }
+  /** \brief Binds the worker to its CPUs and its buffers to its memory node. */
+  void setPlacement(CCpuPlacement *placement) { m_Placement = placement; }
+  /** \brief Limits byte rate, CPU time and I/O priority of the worker. */
+  void setThrottle(CHashingThrottle *throttle) { m_Throttle = throttle; }
+  /** \brief Lends threads of given pool to tree hashes of the worker, NULL
+      hashes them on the worker alone. */
+  void setHelperPool(QThreadPool *pool) { m_HelperPool = pool; }
+  /** \brief Index of the file being hashed or -1, may be sampled from other threads. */
+  int fileIndex(void) { return m_FileIndex; }
+  /** \brief Progress of the current file in percent, may be sampled from other threads. */
   int progress(void) { return m_FileProgress; }
+  /** \brief Running count of hashed bytes, wraps around at 4 GiB.
+
+      Samplers are expected to take differences of successive readings. */
+  quint32 bytesHashed(void) { return (quint32)(int)m_BytesHashed; }
   QString& filePath(void) { return m_FilePath; }
   qint64 fileSize(void) { return m_FileSize; }
-  QByteArray fileHash(void) { return m_FileHash; }
-  bool paused(void) { return m_Paused; }
-  bool cancelled(void) { return m_Cancelled; }
+  bool paused(void) { return (0 != m_Paused); }
+  bool cancelled(void) { return (0 != m_Cancelled); }
   bool status(void) { return m_FileStatus; }
   void run(void);
-  CFileHashingThread();
+  CFileHashingThread(CFileHashingQueue *queue, CBufferPool *pool, const int worker);
+  ~CFileHashingThread();
 };
 
 #endif // FILEHASHINGTHREAD_H
@@ -0,0 +1,54 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filereadingthread.h"
+
+CFileReadingThread::CFileReadingThread(CBlockRing *ring)
+{
+ m_Ring = ring;
+ m_File = NULL;
+ m_End = -1;
+ m_Throttle = NULL;
+}
+
+void CFileReadingThread::run(void)
+{
+ const qint64 fileSize = m_File->size();
+ // a chunk of a split file ends before the file does
+ const qint64 end = (m_End >= 0) ? qMin(m_End,fileSize) : fileSize;
+ // every start makes a new thread, which gets the priority anew
+ int ioGeneration = -1;
+ for (;;)
+ {
+  if (m_Throttle) m_Throttle->applyIoPriority(ioGeneration);
+  char *block = m_Ring->acquireFree();
+  if (NULL == block) return;
+  qint64 length = m_File->read(block,qMin((qint64)m_Ring->blockSize(),end-m_File->pos()));
+  if (length <= 0)
+  {
+   m_Ring->close((0 == length) && (m_File->pos() >= end));
+   return;
+  }
+  m_Ring->commit((int)length);
+  if (m_File->pos() >= end)
+  {
+   m_Ring->close(true);
+   return;
+  }
+ }
+}
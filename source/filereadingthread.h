@@ -0,0 +1,47 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FILEREADINGTHREAD_H
+#define FILEREADINGTHREAD_H
+
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include "blockring.h"
+#include "hashingthrottle.h"
+
+/** \brief Reader stage of a hashing worker, fills a block ring with file data
+    while the worker hashes blocks read earlier. */
+class CFileReadingThread : public QThread
+{
+ Q_OBJECT
+ private:
+  CBlockRing *m_Ring;
+  QFile *m_File;
+  qint64 m_End;
+  CHashingThrottle *m_Throttle;
+ public:
+  /** \brief Sets an open file to read from its current position up to given
+      offset, or to its end if -1 is given. Should be called before start(). */
+  void setFile(QFile *file, const qint64 end = -1) { m_File = file; m_End = end; }
+  /** \brief Takes I/O priority of reads from given throttle, may be NULL. */
+  void setThrottle(CHashingThrottle *throttle) { m_Throttle = throttle; }
+  void run(void);
+  CFileReadingThread(CBlockRing *ring);
+};
+
+#endif // FILEREADINGTHREAD_H
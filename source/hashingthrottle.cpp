@@ -0,0 +1,175 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QMutexLocker>
+#include "hashingthrottle.h"
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// a bucket holds a quarter of a second worth of bytes, so a job that waited
+// for files does not burst far beyond its rate afterwards
+static const int BucketTime = 250;
+// sleeps are short enough for new limits and cancellation to be noticed soon
+static const int SleepSlice = 100;
+// CPU time is accounted over periods of this many milliseconds
+static const int PacePeriod = 100;
+
+CHashingThrottle::CHashingThrottle()
+{
+ m_ByteRate = 0;
+ m_Tokens = 0;
+ m_Limited = 0;
+ m_DutyCycle = 100;
+ m_IoClass = CHashingThrottle::DefaultIo;
+ m_IoLevel = 4;
+ m_IoGeneration = 0;
+ m_Clock.start();
+}
+
+qint64 CHashingThrottle::threadCpuTime(void)
+{
+#if defined(Q_OS_UNIX) && defined(CLOCK_THREAD_CPUTIME_ID)
+ struct timespec time;
+ if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID,&time))
+ {
+  return (qint64)time.tv_sec*1000000+time.tv_nsec/1000;
+ }
+#endif
+ return -1;
+}
+
+void CHashingThrottle::refill(void)
+{
+ const qint64 elapsed = m_Clock.restart();
+ const qint64 capacity = qMax((qint64)0x10000,m_ByteRate*BucketTime/1000);
+ m_Tokens = qMin(capacity,m_Tokens+m_ByteRate*elapsed/1000);
+}
+
+void CHashingThrottle::sleep(const int msecs)
+{
+ // called with the mutex held, setters wake sleepers up
+ m_Changed.wait(&m_Mutex,(unsigned long)qBound(1,msecs,SleepSlice));
+}
+
+void CHashingThrottle::setByteRate(const qint64 rate)
+{
+ QMutexLocker locker(&m_Mutex);
+ refill();
+ m_ByteRate = qMax((qint64)0,rate);
+ m_Tokens = qMin(m_Tokens,(qint64)0);
+ m_Limited.fetchAndStoreOrdered((m_ByteRate > 0) ? 1 : 0);
+ m_Changed.wakeAll();
+}
+
+qint64 CHashingThrottle::byteRate(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ return m_ByteRate;
+}
+
+void CHashingThrottle::setDutyCycle(const int percent)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_DutyCycle.fetchAndStoreOrdered(qBound(1,percent,100));
+ m_Changed.wakeAll();
+}
+
+void CHashingThrottle::setIoPriority(const CHashingThrottle::IoClass ioClass, const int level)
+{
+ m_IoClass.fetchAndStoreOrdered(ioClass);
+ m_IoLevel.fetchAndStoreOrdered(qBound(0,level,7));
+ m_IoGeneration.ref();
+}
+
+void CHashingThrottle::wakeAll(void)
+{
+ QMutexLocker locker(&m_Mutex);
+ m_Changed.wakeAll();
+}
+
+void CHashingThrottle::acquire(const int bytes, const QAtomicInt& cancelled)
+{
+ if (0 == m_Limited) return;
+ QMutexLocker locker(&m_Mutex);
+ refill();
+ // tokens are taken up front, workers waiting at once pay their debt together
+ m_Tokens -= bytes;
+ while ((m_Tokens < 0) && (m_ByteRate > 0) && (0 == cancelled))
+ {
+  sleep((int)((-m_Tokens*1000+m_ByteRate-1)/m_ByteRate));
+  refill();
+ }
+}
+
+void CHashingThrottle::pace(CHashingThrottle::pace_t& pace, const QAtomicInt& cancelled)
+{
+ // time of helpers is dropped while there is no limit to charge it to
+ if (m_DutyCycle >= 100)
+ {
+  pace.helperTime.fetchAndStoreOrdered(0);
+  pace.started = false;
+  return;
+ }
+ if (!pace.started)
+ {
+  pace.clock.start();
+  pace.cpuTime = threadCpuTime();
+  pace.helperTime.fetchAndStoreOrdered(0);
+  pace.started = true;
+  return;
+ }
+ const int wallTime = pace.clock.elapsed();
+ if (wallTime < PacePeriod) return;
+ // without a thread CPU clock all the time is taken as busy
+ const qint64 cpuTime = threadCpuTime();
+ const qint64 busyTime = (((cpuTime >= 0) && (pace.cpuTime >= 0)) ? (cpuTime-pace.cpuTime)/1000 : wallTime)+
+                         pace.helperTime.fetchAndStoreOrdered(0)/1000;
+ QMutexLocker locker(&m_Mutex);
+ int rest = (int)(busyTime*100/m_DutyCycle)-wallTime;
+ while ((rest > 0) && (m_DutyCycle < 100) && (0 == cancelled))
+ {
+  const int slice = qMin(rest,SleepSlice);
+  QTime clock;
+  clock.start();
+  sleep(slice);
+  rest -= qMax(1,clock.elapsed());
+ }
+ locker.unlock();
+ pace.clock.start();
+ pace.cpuTime = threadCpuTime();
+}
+
+void CHashingThrottle::applyIoPriority(int& generation)
+{
+ const int current = m_IoGeneration;
+ if (generation == current) return;
+ generation = current;
+#if defined(Q_OS_LINUX) && defined(SYS_ioprio_set)
+ // IOPRIO_WHO_PROCESS with id 0 is the calling thread, class 0 returns it to
+ // the default derived from its nice value
+ const int who = 1;
+ const int value = (m_IoClass << 13) | ((CHashingThrottle::DefaultIo == m_IoClass) ? 0 : (int)m_IoLevel);
+ syscall(SYS_ioprio_set,who,0,value);
+#endif
+}
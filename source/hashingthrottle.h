@@ -0,0 +1,90 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASHINGTHROTTLE_H
+#define HASHINGTHROTTLE_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QTime>
+#include <QtCore/QWaitCondition>
+
+/** \brief Keeps a hashing job in the background of a busy system.
+
+    Workers of a job share a token bucket, which limits bytes hashed per
+    second by all of them together. Every worker may also be held to a share
+    of CPU time, and reads of its threads may be given an I/O priority class.
+    All limits may be changed while a job runs; workers pick up new values
+    with the next block. */
+class CHashingThrottle
+{
+ public:
+  /** \brief I/O priority classes of Linux, others are not supported. */
+  enum IoClass { DefaultIo = 0, BestEffortIo = 2, IdleIo = 3 };
+  /** \brief CPU time accounting of a single thread. */
+  struct pace_t
+  {
+   QTime clock;
+   qint64 cpuTime;
+   /** \brief Microseconds of CPU used on behalf of the thread by helpers,
+       not yet accounted. */
+   QAtomicInt helperTime;
+   bool started;
+   pace_t() : cpuTime(0), helperTime(0), started(false) {}
+  };
+ private:
+  QMutex m_Mutex;
+  QWaitCondition m_Changed;
+  QTime m_Clock;
+  qint64 m_ByteRate;
+  qint64 m_Tokens;
+  QAtomicInt m_Limited;
+  QAtomicInt m_DutyCycle;
+  QAtomicInt m_IoClass;
+  QAtomicInt m_IoLevel;
+  /** \brief Changes with every new I/O priority, threads compare it with their own. */
+  QAtomicInt m_IoGeneration;
+  void refill(void);
+  void sleep(const int msecs);
+ public:
+  /** \brief Limits bytes per second of all workers, 0 lifts the limit. */
+  void setByteRate(const qint64 rate);
+  qint64 byteRate(void);
+  /** \brief Limits CPU time of every worker to given percent of wall time. */
+  void setDutyCycle(const int percent);
+  int dutyCycle(void) { return m_DutyCycle; }
+  /** \brief Sets I/O priority class and level (0 is highest, 7 lowest). */
+  void setIoPriority(const CHashingThrottle::IoClass ioClass, const int level);
+  CHashingThrottle::IoClass ioClass(void) { return (CHashingThrottle::IoClass)(int)m_IoClass; }
+  int ioLevel(void) { return m_IoLevel; }
+  /** \brief Takes tokens for given number of bytes, sleeps while in debt. */
+  void acquire(const int bytes, const QAtomicInt& cancelled);
+  /** \brief Sleeps as long as the calling thread, together with its helpers,
+      has used more than its share of CPU. */
+  void pace(CHashingThrottle::pace_t& pace, const QAtomicInt& cancelled);
+  /** \brief CPU time of the calling thread in microseconds, -1 if not known. */
+  static qint64 threadCpuTime(void);
+  /** \brief Applies I/O priority to the calling thread if it changed since
+      the thread last did so, generation -1 applies it anyway. */
+  void applyIoPriority(int& generation);
+  /** \brief Wakes sleeping threads, so that they notice cancellation. */
+  void wakeAll(void);
+  CHashingThrottle();
+};
+
+#endif // HASHINGTHROTTLE_H
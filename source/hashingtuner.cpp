@@ -0,0 +1,226 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include "hashingtuner.h"
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
+
+#ifdef Q_OS_LINUX
+static double readCpuLimit(const QString& fileName, const bool unified)
+{
+ QFile file(fileName);
+ if (!file.open(QIODevice::ReadOnly)) return 0;
+ const QString text = QString::fromLatin1(file.readAll().constData()).trimmed();
+ if (unified)
+ {
+  // cgroup v2 "cpu.max" holds "$MAX $PERIOD", where $MAX may be "max"
+  const QStringList fields = text.split(' ');
+  if ((fields.count() < 2) || (fields.at(0) == "max")) return 0;
+  const double period = fields.at(1).toDouble();
+  return (period > 0) ? fields.at(0).toDouble()/period : 0;
+ }
+ // cgroup v1 "cpu.cfs_quota_us" is -1 when unlimited
+ const double quota = text.toDouble();
+ if (quota <= 0) return 0;
+ QFile periodFile(fileName.left(fileName.lastIndexOf('/'))+"/cpu.cfs_period_us");
+ if (!periodFile.open(QIODevice::ReadOnly)) return 0;
+ const double period = QString::fromLatin1(periodFile.readAll().constData()).trimmed().toDouble();
+ return (period > 0) ? quota/period : 0;
+}
+
+static double cgroupCpuLimit(void)
+{
+ QFile cgroups("/proc/self/cgroup");
+ if (!cgroups.open(QIODevice::ReadOnly)) return 0;
+ const QStringList lines = QString::fromLatin1(cgroups.readAll().constData()).split('\n');
+ double limit = 0;
+ for (int i = 0, n = lines.count(); i < n; i++)
+ {
+  // "hierarchy-ID:controller-list:cgroup-path"
+  const QString controllers = lines.at(i).section(':',1,1);
+  QString path = lines.at(i).section(':',2);
+  if (path.isEmpty()) continue;
+  if (controllers.isEmpty())
+  {
+   // a quota of any ancestor applies as well, take the tightest one
+   for (;;)
+   {
+    const double quota = readCpuLimit("/sys/fs/cgroup"+path+"/cpu.max",true);
+    if ((quota > 0) && ((0 == limit) || (quota < limit))) limit = quota;
+    if (path.length() <= 1) break;
+    path = path.left(qMax(1,path.lastIndexOf('/')));
+  }}
+  else if (controllers.split(',').contains("cpu"))
+  {
+   const QString mount = QFile::exists("/sys/fs/cgroup/cpu") ?
+                         "/sys/fs/cgroup/cpu" : "/sys/fs/cgroup/cpu,cpuacct";
+   const double quota = readCpuLimit(mount+path+"/cpu.cfs_quota_us",false);
+   if ((quota > 0) && ((0 == limit) || (quota < limit))) limit = quota;
+ }}
+ return limit;
+}
+#endif
+
+CHashingTuner::CHashingTuner()
+{
+ // a window should span several progress samples and a number of files
+ m_WindowLength = 2000;
+ setup(1,0x100000,0x100000,1);
+}
+
+int CHashingTuner::availableCpuCount(void)
+{
+ int count = QThread::idealThreadCount();
+#ifdef Q_OS_LINUX
+ cpu_set_t set;
+ CPU_ZERO(&set);
+ if (0 == sched_getaffinity(0,sizeof(set),&set)) count = CPU_COUNT(&set);
+ // fractional quota still lets one more thread make progress
+ const double quota = cgroupCpuLimit();
+ if (quota > 0) count = qMin(count,(int)(quota+0.999));
+#endif
+ return qMax(1,count);
+}
+
+void CHashingTuner::setup(const int maxWorkers, const int blockSize, const int maxBlockSize,
+                          const int maxRingDepth)
+{
+ m_Minimum[Workers] = 1;
+ m_Maximum[Workers] = qMax(1,maxWorkers);
+ m_Values[Workers] = m_Maximum[Workers];
+ // block sizes stay powers of two times a page, as direct reads require
+ m_Minimum[BlockSize] = qMin(0x10000,maxBlockSize);
+ m_Maximum[BlockSize] = maxBlockSize;
+ m_Values[BlockSize] = qBound(m_Minimum[BlockSize],blockSize,m_Maximum[BlockSize]);
+ m_Minimum[RingDepth] = 1;
+ m_Maximum[RingDepth] = qMax(1,maxRingDepth);
+ m_Values[RingDepth] = m_Maximum[RingDepth];
+ m_State = Measuring;
+ m_Parameter = Workers;
+ m_Direction = -1;
+ m_PreviousValue = 0;
+ m_Failures = 0;
+ m_RestingWindows = 0;
+ m_BaseBytesRate = 0;
+ m_BaseFilesRate = 0;
+ m_WindowBytes = 0;
+ m_WindowFiles = 0;
+ m_WindowTime = 0;
+}
+
+bool CHashingTuner::step(void)
+{
+ const int value = m_Values[m_Parameter];
+ int next;
+ if (BlockSize == m_Parameter) next = (m_Direction > 0) ? value*2 : value/2;
+ else next = value+m_Direction;
+ if ((next < m_Minimum[m_Parameter]) || (next > m_Maximum[m_Parameter])) return false;
+ m_PreviousValue = value;
+ m_Values[m_Parameter] = next;
+ return true;
+}
+
+void CHashingTuner::advance(void)
+{
+ // try the opposite direction first, then move on to the next parameter
+ if (m_Direction < 0)
+ {
+  m_Direction = 1;
+ }
+ else
+ {
+  m_Direction = -1;
+  m_Parameter = (m_Parameter+1) % ParameterCount;
+ }
+ m_Failures++;
+}
+
+bool CHashingTuner::sample(const qint64 bytes, const int files, const int elapsed)
+{
+ m_WindowBytes += bytes;
+ m_WindowFiles += files;
+ m_WindowTime += elapsed;
+ if (m_WindowTime < m_WindowLength) return false;
+ const double bytesRate = 1000.0*m_WindowBytes/m_WindowTime;
+ const double filesRate = 1000.0*m_WindowFiles/m_WindowTime;
+ m_WindowBytes = 0;
+ m_WindowFiles = 0;
+ m_WindowTime = 0;
+ bool changed = false;
+ switch (m_State)
+ {
+  case Resting:
+  {
+   if (--m_RestingWindows > 0) return false;
+   m_State = Measuring;
+   return false;
+  }
+  case Trying:
+  {
+   // differences within a few percent are taken as noise
+   const bool faster =
+    ((bytesRate > 1.05*m_BaseBytesRate) && (filesRate >= 0.95*m_BaseFilesRate)) ||
+    ((filesRate > 1.05*m_BaseFilesRate) && (bytesRate >= 0.95*m_BaseBytesRate));
+   if (faster)
+   {
+    m_Failures = 0;
+    m_BaseBytesRate = bytesRate;
+    m_BaseFilesRate = filesRate;
+    // keep going the same way while it pays off
+    if (step()) return true;
+    advance();
+   }
+   else
+   {
+    m_Values[m_Parameter] = m_PreviousValue;
+    changed = true;
+    advance();
+   }
+   m_State = Measuring;
+   break;
+  }
+  case Measuring:
+  {
+   m_BaseBytesRate = bytesRate;
+   m_BaseFilesRate = filesRate;
+   // look for a step that can be taken from the current values
+   while (m_Failures < 2*ParameterCount)
+   {
+    if (step())
+    {
+     m_State = Trying;
+     return true;
+    }
+    advance();
+   }
+   break;
+  }
+ }
+ if (m_Failures >= 2*ParameterCount)
+ {
+  m_Failures = 0;
+  m_State = Resting;
+  m_RestingWindows = 15;
+ }
+ return changed;
+}
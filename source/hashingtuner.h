@@ -0,0 +1,69 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASHINGTUNER_H
+#define HASHINGTUNER_H
+
+#include <QtCore/QtGlobal>
+
+/** \brief Adjusts a running hashing job to the throughput it achieves.
+
+    Number of active workers, block size and read-ahead depth are tuned one
+    at a time by hill climbing. Throughput is measured over windows of a few
+    seconds; a step is kept if it raised either bytes or files per second
+    without lowering the other, otherwise it is undone and the opposite
+    direction or the next parameter is tried. When no step helps the tuner
+    rests for a while before it tries again. */
+class CHashingTuner
+{
+ public:
+  enum Parameter { Workers, BlockSize, RingDepth, ParameterCount };
+ private:
+  enum State { Measuring, Trying, Resting };
+  int m_Values[ParameterCount];
+  int m_Minimum[ParameterCount];
+  int m_Maximum[ParameterCount];
+  CHashingTuner::State m_State;
+  int m_Parameter;
+  int m_Direction;
+  int m_PreviousValue;
+  int m_Failures;
+  int m_RestingWindows;
+  double m_BaseBytesRate;
+  double m_BaseFilesRate;
+  qint64 m_WindowBytes;
+  qint64 m_WindowFiles;
+  qint64 m_WindowTime;
+  qint64 m_WindowLength;
+  bool step(void);
+  void advance(void);
+ public:
+  /** \brief Starts tuning with all workers and the deepest read-ahead. */
+  void setup(const int maxWorkers, const int blockSize, const int maxBlockSize,
+             const int maxRingDepth);
+  /** \brief Accounts work done since the previous call, returns true if values changed. */
+  bool sample(const qint64 bytes, const int files, const int elapsed);
+  int workers(void) { return m_Values[Workers]; }
+  int blockSize(void) { return m_Values[BlockSize]; }
+  int ringDepth(void) { return m_Values[RingDepth]; }
+  /** \brief Number of CPUs the process may use, honouring cpuset and cgroup quota. */
+  static int availableCpuCount(void);
+  CHashingTuner();
+};
+
+#endif // HASHINGTUNER_H
@@ -0,0 +1,258 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "feature.h"
+#include "iouring.h"
+
+#if defined(FEATURE_IO_URING) && defined(Q_OS_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#define IOURING_ENABLED
+#endif
+
+CIoUring::CIoUring()
+{
+ m_Fd = -1;
+ m_SqRing = NULL;
+ m_CqRing = NULL;
+ m_Sqes = NULL;
+ m_Cqes = NULL;
+ m_SqRingSize = 0;
+ m_CqRingSize = 0;
+ m_SqesSize = 0;
+ m_SqHead = m_SqTail = m_SqMask = m_SqArray = NULL;
+ m_CqHead = m_CqTail = m_CqMask = NULL;
+ m_Entries = 0;
+ m_Queued = 0;
+ m_InFlight = 0;
+}
+
+CIoUring::~CIoUring()
+{
+ release();
+}
+
+bool CIoUring::setup(const unsigned int entries)
+{
+ release();
+#ifdef IOURING_ENABLED
+ struct io_uring_params params;
+ memset(&params,0,sizeof(params));
+ // fails with ENOSYS on old kernels and EPERM where io_uring is disabled
+ m_Fd = (int)syscall(__NR_io_uring_setup,entries,&params);
+ if (m_Fd < 0) return false;
+ m_SqRingSize = params.sq_off.array+params.sq_entries*sizeof(unsigned int);
+ m_CqRingSize = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+ const bool singleMap = (0 != (params.features & IORING_FEAT_SINGLE_MMAP));
+ if (singleMap) m_SqRingSize = m_CqRingSize = qMax(m_SqRingSize,m_CqRingSize);
+ m_SqRing = mmap(NULL,m_SqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                 m_Fd,IORING_OFF_SQ_RING);
+ if (MAP_FAILED == m_SqRing)
+ {
+  m_SqRing = NULL;
+  release();
+  return false;
+ }
+ if (singleMap)
+ {
+  m_CqRing = m_SqRing;
+ }
+ else
+ {
+  m_CqRing = mmap(NULL,m_CqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+                  m_Fd,IORING_OFF_CQ_RING);
+  if (MAP_FAILED == m_CqRing)
+  {
+   m_CqRing = NULL;
+   release();
+   return false;
+ }}
+ m_SqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+ m_Sqes = mmap(NULL,m_SqesSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+               m_Fd,IORING_OFF_SQES);
+ if (MAP_FAILED == m_Sqes)
+ {
+  m_Sqes = NULL;
+  release();
+  return false;
+ }
+ char *sq = (char *)m_SqRing;
+ m_SqHead = (unsigned int *)(sq+params.sq_off.head);
+ m_SqTail = (unsigned int *)(sq+params.sq_off.tail);
+ m_SqMask = (unsigned int *)(sq+params.sq_off.ring_mask);
+ m_SqArray = (unsigned int *)(sq+params.sq_off.array);
+ char *cq = (char *)m_CqRing;
+ m_CqHead = (unsigned int *)(cq+params.cq_off.head);
+ m_CqTail = (unsigned int *)(cq+params.cq_off.tail);
+ m_CqMask = (unsigned int *)(cq+params.cq_off.ring_mask);
+ m_Cqes = cq+params.cq_off.cqes;
+ m_Entries = params.sq_entries;
+ if (!probe())
+ {
+  release();
+  return false;
+ }
+ return true;
+#else
+ Q_UNUSED(entries);
+ return false;
+#endif
+}
+
+void CIoUring::release(void)
+{
+#ifdef IOURING_ENABLED
+ if (NULL != m_Sqes) munmap(m_Sqes,m_SqesSize);
+ if ((NULL != m_CqRing) && (m_CqRing != m_SqRing)) munmap(m_CqRing,m_CqRingSize);
+ if (NULL != m_SqRing) munmap(m_SqRing,m_SqRingSize);
+ if (m_Fd >= 0) ::close(m_Fd);
+#endif
+ m_Fd = -1;
+ m_SqRing = NULL;
+ m_CqRing = NULL;
+ m_Sqes = NULL;
+ m_Cqes = NULL;
+ m_Entries = 0;
+ m_Queued = 0;
+ m_InFlight = 0;
+}
+
+bool CIoUring::probe(void)
+{
+#ifdef IOURING_ENABLED
+ // opening and reading by io_uring appeared in 5.6, same as the probe itself
+ const unsigned int count = 256;
+ struct io_uring_probe *ops = (struct io_uring_probe *)
+  calloc(1,sizeof(struct io_uring_probe)+count*sizeof(struct io_uring_probe_op));
+ if (NULL == ops) return false;
+ bool result = (syscall(__NR_io_uring_register,m_Fd,IORING_REGISTER_PROBE,ops,count) >= 0) &&
+               (ops->last_op >= IORING_OP_READ) &&
+               (0 != (ops->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)) &&
+               (0 != (ops->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED));
+ free(ops);
+ return result;
+#else
+ return false;
+#endif
+}
+
+void *CIoUring::prepare(void)
+{
+#ifdef IOURING_ENABLED
+ // completion queue is twice as large, keeping requests within the
+ // submission queue size guarantees that completions never overflow
+ if ((m_Fd < 0) || (m_Queued+m_InFlight >= m_Entries)) return NULL;
+ const unsigned int tail = *m_SqTail;
+ const unsigned int slot = tail & *m_SqMask;
+ struct io_uring_sqe *sqe = (struct io_uring_sqe *)m_Sqes+slot;
+ memset(sqe,0,sizeof(struct io_uring_sqe));
+ m_SqArray[slot] = slot;
+ __atomic_store_n(m_SqTail,tail+1,__ATOMIC_RELEASE);
+ m_Queued++;
+ return sqe;
+#else
+ return NULL;
+#endif
+}
+
+bool CIoUring::prepareOpen(const char *path, const quint64 tag)
+{
+#ifdef IOURING_ENABLED
+ struct io_uring_sqe *sqe = (struct io_uring_sqe *)prepare();
+ if (NULL == sqe) return false;
+ sqe->opcode = IORING_OP_OPENAT;
+ sqe->fd = AT_FDCWD;
+ sqe->addr = (quint64)(quintptr)path;
+ sqe->open_flags = O_RDONLY|O_CLOEXEC;
+ sqe->user_data = tag;
+ return true;
+#else
+ Q_UNUSED(path); Q_UNUSED(tag);
+ return false;
+#endif
+}
+
+bool CIoUring::prepareRead(const int fd, char *buffer, const unsigned int length, const quint64 tag)
+{
+#ifdef IOURING_ENABLED
+ struct io_uring_sqe *sqe = (struct io_uring_sqe *)prepare();
+ if (NULL == sqe) return false;
+ sqe->opcode = IORING_OP_READ;
+ sqe->fd = fd;
+ sqe->addr = (quint64)(quintptr)buffer;
+ sqe->len = length;
+ sqe->off = 0;
+ sqe->user_data = tag;
+ return true;
+#else
+ Q_UNUSED(fd); Q_UNUSED(buffer); Q_UNUSED(length); Q_UNUSED(tag);
+ return false;
+#endif
+}
+
+bool CIoUring::submit(void)
+{
+#ifdef IOURING_ENABLED
+ while (m_Queued > 0)
+ {
+  const int submitted = (int)syscall(__NR_io_uring_enter,m_Fd,m_Queued,0,0,NULL,0);
+  if (submitted < 0)
+  {
+   if (EINTR == errno) continue;
+   return false;
+  }
+  if (0 == submitted) return false;
+  m_Queued -= submitted;
+  m_InFlight += submitted;
+ }
+ return true;
+#else
+ return false;
+#endif
+}
+
+bool CIoUring::complete(quint64& tag, int& result)
+{
+#ifdef IOURING_ENABLED
+ while (m_InFlight > 0)
+ {
+  const unsigned int head = *m_CqHead;
+  if (head != __atomic_load_n(m_CqTail,__ATOMIC_ACQUIRE))
+  {
+   const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)m_Cqes+(head & *m_CqMask);
+   tag = cqe->user_data;
+   result = cqe->res;
+   __atomic_store_n(m_CqHead,head+1,__ATOMIC_RELEASE);
+   m_InFlight--;
+   return true;
+  }
+  if ((syscall(__NR_io_uring_enter,m_Fd,0,1,IORING_ENTER_GETEVENTS,NULL,0) < 0) &&
+      (EINTR != errno)) return false;
+ }
+ return false;
+#else
+ Q_UNUSED(tag); Q_UNUSED(result);
+ return false;
+#endif
+}
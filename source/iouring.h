@@ -0,0 +1,76 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IOURING_H
+#define IOURING_H
+
+#include <QtCore/QtGlobal>
+
+/** \brief Minimal Linux io_uring submission/completion queue.
+
+    Used to open and read batches of small files with a couple of system
+    calls instead of three per file. Talks to the kernel through raw system
+    calls, so no liburing is needed. setup() fails on other systems, on
+    kernels without io_uring or without support for required operations,
+    callers are expected to fall back to regular file access then. */
+class CIoUring
+{
+ private:
+  int m_Fd;
+  void *m_SqRing;
+  void *m_CqRing;
+  void *m_Sqes;
+  void *m_Cqes;
+  size_t m_SqRingSize;
+  size_t m_CqRingSize;
+  size_t m_SqesSize;
+  unsigned int *m_SqHead;
+  unsigned int *m_SqTail;
+  unsigned int *m_SqMask;
+  unsigned int *m_SqArray;
+  unsigned int *m_CqHead;
+  unsigned int *m_CqTail;
+  unsigned int *m_CqMask;
+  unsigned int m_Entries;
+  unsigned int m_Queued;
+  unsigned int m_InFlight;
+  bool probe(void);
+  void *prepare(void);
+ public:
+  /** \brief Creates a ring of at least given number of entries, returns false if unavailable. */
+  bool setup(const unsigned int entries);
+  void release(void);
+  bool isValid(void) { return m_Fd >= 0; }
+  /** \brief Number of requests that may be queued and in flight at once. */
+  unsigned int entries(void) { return m_Entries; }
+  /** \brief Queues opening of a file for reading, path must stay valid until submitted. */
+  bool prepareOpen(const char *path, const quint64 tag);
+  /** \brief Queues reading from the beginning of an open file. */
+  bool prepareRead(const int fd, char *buffer, const unsigned int length, const quint64 tag);
+  /** \brief Passes queued requests to the kernel. */
+  bool submit(void);
+  /** \brief Takes next completion, waiting for it if necessary.
+
+      Returns false when no requests are in flight. Result is a file
+      descriptor or a byte count on success and negated errno on failure. */
+  bool complete(quint64& tag, int& result);
+  CIoUring();
+  ~CIoUring();
+};
+
+#endif // IOURING_H
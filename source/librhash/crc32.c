@@ -5,6 +5,25 @@
 #include "byte_order.h"
 #include "crc32.h"
 
+/* carry-less multiplication kernel is compiled for x86 with compilers able to
+ * target single functions, so the rest of the library needs no extra flags */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define CRC32_PCLMUL
+# define CRC32_TARGET __attribute__((target("pclmul,sse4.1")))
+# include <cpuid.h>
+#elif defined(_MSC_VER) && (_MSC_VER >= 1500) && (defined(_M_X64) || defined(_M_IX86))
+# define CRC32_PCLMUL
+# define CRC32_TARGET
+# include <intrin.h>
+#endif
+
+#ifdef CRC32_PCLMUL
+# include <emmintrin.h>
+# include <smmintrin.h>
+# include <wmmintrin.h>
+#endif
+
 #ifdef GENERATE_CRC32_TABLE
 unsigned crcTable[256];
 
@@ -72,6 +91,221 @@ unsigned get_crc32_str(unsigned crcinit, const char *str) {
   return get_crc32(crcinit, str, strlen(str));
 }
 
+/* crcSlices[k][i] is crc of byte i followed by k zero bytes, crcSlices[0]
+ * is crcTable; slicing by 16 looks up 16 message bytes at once */
+static unsigned crcSlices[16][256];
+
+/* crcPowers[k] is x^(2^k) modulo the polynomial, bit-reflected */
+static unsigned crcPowers[32];
+
+/* 1 if the carry-less multiplication kernel may be used, -1 before tables and
+ * CPU features are examined */
+static int crcPclmul = -1;
+
+/**
+ * Multiply two bit-reflected polynomials modulo the CRC32 polynomial.
+ *
+ * @param a the first polynomial, x^0 is its highest bit
+ * @param b the second polynomial
+ * @return the product
+ */
+static unsigned crc32_multiply(unsigned a, unsigned b) {
+  unsigned m = 0x80000000, p = 0;
+  for(;;) {
+    if(a & m) {
+      p ^= b;
+      if((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+  }
+  return p;
+}
+
+/**
+ * Tell if the CPU supports the carry-less multiplication kernel.
+ *
+ * @return 1 if it does, 0 otherwise
+ */
+static int crc32_pclmul_supported(void) {
+#if defined(CRC32_PCLMUL) && defined(__GNUC__)
+  unsigned eax, ebx, ecx, edx;
+  return (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+    (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1)) ? 1 : 0;
+#elif defined(CRC32_PCLMUL)
+  int info[4];
+  __cpuid(info, 1);
+  return ((info[2] & (1 << 1)) && (info[2] & (1 << 19))) ? 1 : 0;
+#else
+  return 0;
+#endif
+}
+
+static void crc32_init(void) {
+  int i, k;
+  unsigned p = 0x40000000; /* x^1 */
+  for(k=0; k<32; k++) {
+    crcPowers[k] = p;
+    p = crc32_multiply(p, p);
+  }
+  for(i=0; i<256; i++) {
+    crcSlices[0][i] = crcTable[i];
+    for(k=1; k<16; k++)
+      crcSlices[k][i] = crcTable[crcSlices[k-1][i] & 0xFF] ^ (crcSlices[k-1][i] >> 8);
+  }
+  crcPclmul = crc32_pclmul_supported();
+}
+
+#ifdef __GNUC__
+/* tables are ready before any thread may hash, other compilers build them
+ * with the first call, which writes the same values if threads race */
+static void crc32_init_early(void) __attribute__((constructor));
+static void crc32_init_early(void) {
+  crc32_init();
+}
+#endif
+
+/**
+ * Process 16 byte blocks of a DWORD aligned message, eight table lookups
+ * per DWORD are replaced by four independent ones.
+ *
+ * @param crc intermediate crc32 register value (not inverted)
+ * @param p the message to process
+ * @param count the number of 16 byte blocks
+ * @return crc32 register value
+ */
+static unsigned crc32_slice16(unsigned crc, const char *p, unsigned count) {
+  const unsigned *w = (const unsigned *)p;
+  for(; count>0; count--, w+=4) {
+    unsigned w0 = crc ^ le2me_32(w[0]);
+    unsigned w1 = le2me_32(w[1]);
+    unsigned w2 = le2me_32(w[2]);
+    unsigned w3 = le2me_32(w[3]);
+    crc = crcSlices[15][w0 & 0xFF] ^ crcSlices[14][(w0 >> 8) & 0xFF] ^
+          crcSlices[13][(w0 >> 16) & 0xFF] ^ crcSlices[12][w0 >> 24] ^
+          crcSlices[11][w1 & 0xFF] ^ crcSlices[10][(w1 >> 8) & 0xFF] ^
+          crcSlices[9][(w1 >> 16) & 0xFF] ^ crcSlices[8][w1 >> 24] ^
+          crcSlices[7][w2 & 0xFF] ^ crcSlices[6][(w2 >> 8) & 0xFF] ^
+          crcSlices[5][(w2 >> 16) & 0xFF] ^ crcSlices[4][w2 >> 24] ^
+          crcSlices[3][w3 & 0xFF] ^ crcSlices[2][(w3 >> 8) & 0xFF] ^
+          crcSlices[1][(w3 >> 16) & 0xFF] ^ crcSlices[0][w3 >> 24];
+  }
+  return crc;
+}
+
+#ifdef CRC32_PCLMUL
+/**
+ * Fold a message with carry-less multiplication, as described in the Intel
+ * paper "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction". Constants are those of the bit-reflected CRC32 polynomial.
+ *
+ * @param crc intermediate crc32 register value (not inverted)
+ * @param p the message to process
+ * @param len the length of the message, a multiple of 16 not less than 64
+ * @return crc32 register value
+ */
+static CRC32_TARGET unsigned crc32_pclmul(unsigned crc, const char *p, unsigned len) {
+  const __m128i k1k2 = _mm_set_epi32(0x00000001, 0xc6e41596, 0x00000001, 0x54442bd4);
+  const __m128i k3k4 = _mm_set_epi32(0x00000000, 0xccaa009e, 0x00000001, 0x751997d0);
+  const __m128i k5k0 = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63cd6124);
+  const __m128i poly = _mm_set_epi32(0x00000001, 0xf7011641, 0x00000001, 0xdb710641);
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  p += 64;
+  len -= 64;
+
+  /* fold four 128-bit lanes in parallel */
+  for(; len>=64; p+=64, len-=64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(p + 0x30)));
+  }
+
+  /* fold the lanes into one */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* fold remaining 16 byte blocks */
+  for(; len>=16; p+=16, len-=16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+  }
+
+  /* fold 128 bits to 64 */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (unsigned)_mm_extract_epi32(x1, 1);
+}
+#endif /* CRC32_PCLMUL */
+
+/**
+ * Select the kernel of get_crc32, for tests mostly. Threads hashing at the
+ * time may use either kernel for their next call, both give the same sums.
+ *
+ * @param pclmul 1 to use carry-less multiplication where the CPU supports it,
+ *               0 for the table kernel alone
+ * @return 1 if carry-less multiplication is used, 0 otherwise
+ */
+int crc32_select(int pclmul) {
+  if(crcPclmul < 0) crc32_init();
+  crcPclmul = (pclmul && crc32_pclmul_supported()) ? 1 : 0;
+  return crcPclmul;
+}
+
+/**
+ * Combine CRC32 sums of two consecutive messages into the sum of the whole,
+ * the first sum is shifted over the second message in GF(2) and added to it.
+ *
+ * @param crc1 crc32 sum of the first message
+ * @param crc2 crc32 sum of the second message, calculated from zero
+ * @param len2 the length of the second message
+ * @return crc32 sum of both messages
+ */
+unsigned crc32_combine(unsigned crc1, unsigned crc2, uint64_t len2) {
+  unsigned p = 0x80000000; /* x^0 */
+  int k = 3; /* a byte is x^8 */
+
+  if(crcPclmul < 0) crc32_init();
+  for(; len2; len2 >>= 1, k++) {
+    if(len2 & 1) p = crc32_multiply(crcPowers[k & 31], p);
+  }
+  return crc32_multiply(p, crc1) ^ crc2;
+}
+
 /**
  * Calculate CRC32 sum of a given message
  *
@@ -84,11 +318,26 @@ unsigned get_crc32(unsigned crcinit, const char *p, unsigned len) {
   register unsigned crc = crcinit ^ 0xFFFFFFFF;
   const char *e;
 
+  if(crcPclmul < 0) crc32_init();
+
+#ifdef CRC32_PCLMUL
+  /* whole 16 byte blocks of a long enough message are folded */
+  if(crcPclmul > 0 && len >= 64) {
+    unsigned n = len & ~15;
+    crc = crc32_pclmul(crc, p, n);
+    p += n;
+    len -= n;
+  }
+#endif
+
   /* process not aligned message head */
   for(; (3 & (p - (const char*)0)) && len>0; p++, len--) 
     crc = crcTable[(crc ^ *p) & 0xFF] ^ (crc >> 8);
 
   /* fast crc32 calculation of a DWORD aligned message */
+  crc = crc32_slice16(crc, p, len >> 4);
+  p += len & ~15;
+  len &= 15;
   e = p + (len & ~3);
   for(; p<e; p+=4) {
     crc ^= le2me_32( *(const unsigned *)p );
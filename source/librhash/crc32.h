@@ -2,6 +2,8 @@
 #ifndef CRC32_H
 #define CRC32_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -10,6 +12,8 @@ extern "C" {
 
 unsigned get_crc32(unsigned crcinit, const char *c, unsigned len);
 unsigned get_crc32_str(unsigned crcinit, const char *str);
+unsigned crc32_combine(unsigned crc1, unsigned crc2, uint64_t len2);
+int crc32_select(int pclmul);
 
 #ifdef __cplusplus
 } /* extern "C" */
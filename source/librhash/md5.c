@@ -7,6 +7,28 @@
 #include "byte_order.h"
 #include "md5.h"
 
+/* multi-buffer kernels are compiled for x86 with compilers able to
+ * target single functions, so the rest of the library needs no extra flags */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define MD5_MULTI
+# define MD5_TARGET(x) __attribute__((target(x)))
+# include <cpuid.h>
+#elif defined(_MSC_VER) && (_MSC_VER >= 1900) && (defined(_M_X64) || defined(_M_IX86))
+# define MD5_MULTI
+# define MD5_TARGET(x)
+# include <intrin.h>
+#endif
+
+#ifdef MD5_MULTI
+# include <immintrin.h>
+#endif
+
+/* lane counts of the kernels the CPU supports, or-ed together, and messages
+ * hashed side by side by the kernel in use; -1 until detected */
+static int md5Kernels = -1;
+static int md5Lanes = -1;
+
 void md5_init(md5_ctx *ctx) {
   ctx->length = 0;
 
@@ -202,3 +224,376 @@ void md5_final(md5_ctx *ctx, unsigned char result[16]) {
 
   le32_copy(result, &ctx->state, 16);
 }
+
+#ifdef MD5_MULTI
+/* the kernel body is written once over vector operations V_*, which each
+ * kernel defines for its register width before expanding it; a step adds
+ * word k of every lane's block */
+#define MD5_MB_STEP(f, a, b, c, d, k, s, ac) \
+  a = V_ADD(V_ADD(a, f(b, c, d)), V_ADD(V_LOAD(words + (k) * LANES), V_SET1(ac))); \
+  a = V_ADD(V_ROL(a, s), b);
+
+#define MD5_MB_KERNEL_BODY \
+  V a, b, c, d; \
+  a = V_LOAD(state + 0 * LANES); \
+  b = V_LOAD(state + 1 * LANES); \
+  c = V_LOAD(state + 2 * LANES); \
+  d = V_LOAD(state + 3 * LANES); \
+  MD5_MB_STEP(V_F, a, b, c, d,  0,  7, 0xd76aa478); \
+  MD5_MB_STEP(V_F, d, a, b, c,  1, 12, 0xe8c7b756); \
+  MD5_MB_STEP(V_F, c, d, a, b,  2, 17, 0x242070db); \
+  MD5_MB_STEP(V_F, b, c, d, a,  3, 22, 0xc1bdceee); \
+  MD5_MB_STEP(V_F, a, b, c, d,  4,  7, 0xf57c0faf); \
+  MD5_MB_STEP(V_F, d, a, b, c,  5, 12, 0x4787c62a); \
+  MD5_MB_STEP(V_F, c, d, a, b,  6, 17, 0xa8304613); \
+  MD5_MB_STEP(V_F, b, c, d, a,  7, 22, 0xfd469501); \
+  MD5_MB_STEP(V_F, a, b, c, d,  8,  7, 0x698098d8); \
+  MD5_MB_STEP(V_F, d, a, b, c,  9, 12, 0x8b44f7af); \
+  MD5_MB_STEP(V_F, c, d, a, b, 10, 17, 0xffff5bb1); \
+  MD5_MB_STEP(V_F, b, c, d, a, 11, 22, 0x895cd7be); \
+  MD5_MB_STEP(V_F, a, b, c, d, 12,  7, 0x6b901122); \
+  MD5_MB_STEP(V_F, d, a, b, c, 13, 12, 0xfd987193); \
+  MD5_MB_STEP(V_F, c, d, a, b, 14, 17, 0xa679438e); \
+  MD5_MB_STEP(V_F, b, c, d, a, 15, 22, 0x49b40821); \
+  MD5_MB_STEP(V_G, a, b, c, d,  1,  5, 0xf61e2562); \
+  MD5_MB_STEP(V_G, d, a, b, c,  6,  9, 0xc040b340); \
+  MD5_MB_STEP(V_G, c, d, a, b, 11, 14, 0x265e5a51); \
+  MD5_MB_STEP(V_G, b, c, d, a,  0, 20, 0xe9b6c7aa); \
+  MD5_MB_STEP(V_G, a, b, c, d,  5,  5, 0xd62f105d); \
+  MD5_MB_STEP(V_G, d, a, b, c, 10,  9, 0x02441453); \
+  MD5_MB_STEP(V_G, c, d, a, b, 15, 14, 0xd8a1e681); \
+  MD5_MB_STEP(V_G, b, c, d, a,  4, 20, 0xe7d3fbc8); \
+  MD5_MB_STEP(V_G, a, b, c, d,  9,  5, 0x21e1cde6); \
+  MD5_MB_STEP(V_G, d, a, b, c, 14,  9, 0xc33707d6); \
+  MD5_MB_STEP(V_G, c, d, a, b,  3, 14, 0xf4d50d87); \
+  MD5_MB_STEP(V_G, b, c, d, a,  8, 20, 0x455a14ed); \
+  MD5_MB_STEP(V_G, a, b, c, d, 13,  5, 0xa9e3e905); \
+  MD5_MB_STEP(V_G, d, a, b, c,  2,  9, 0xfcefa3f8); \
+  MD5_MB_STEP(V_G, c, d, a, b,  7, 14, 0x676f02d9); \
+  MD5_MB_STEP(V_G, b, c, d, a, 12, 20, 0x8d2a4c8a); \
+  MD5_MB_STEP(V_H, a, b, c, d,  5,  4, 0xfffa3942); \
+  MD5_MB_STEP(V_H, d, a, b, c,  8, 11, 0x8771f681); \
+  MD5_MB_STEP(V_H, c, d, a, b, 11, 16, 0x6d9d6122); \
+  MD5_MB_STEP(V_H, b, c, d, a, 14, 23, 0xfde5380c); \
+  MD5_MB_STEP(V_H, a, b, c, d,  1,  4, 0xa4beea44); \
+  MD5_MB_STEP(V_H, d, a, b, c,  4, 11, 0x4bdecfa9); \
+  MD5_MB_STEP(V_H, c, d, a, b,  7, 16, 0xf6bb4b60); \
+  MD5_MB_STEP(V_H, b, c, d, a, 10, 23, 0xbebfbc70); \
+  MD5_MB_STEP(V_H, a, b, c, d, 13,  4, 0x289b7ec6); \
+  MD5_MB_STEP(V_H, d, a, b, c,  0, 11, 0xeaa127fa); \
+  MD5_MB_STEP(V_H, c, d, a, b,  3, 16, 0xd4ef3085); \
+  MD5_MB_STEP(V_H, b, c, d, a,  6, 23, 0x04881d05); \
+  MD5_MB_STEP(V_H, a, b, c, d,  9,  4, 0xd9d4d039); \
+  MD5_MB_STEP(V_H, d, a, b, c, 12, 11, 0xe6db99e5); \
+  MD5_MB_STEP(V_H, c, d, a, b, 15, 16, 0x1fa27cf8); \
+  MD5_MB_STEP(V_H, b, c, d, a,  2, 23, 0xc4ac5665); \
+  MD5_MB_STEP(V_I, a, b, c, d,  0,  6, 0xf4292244); \
+  MD5_MB_STEP(V_I, d, a, b, c,  7, 10, 0x432aff97); \
+  MD5_MB_STEP(V_I, c, d, a, b, 14, 15, 0xab9423a7); \
+  MD5_MB_STEP(V_I, b, c, d, a,  5, 21, 0xfc93a039); \
+  MD5_MB_STEP(V_I, a, b, c, d, 12,  6, 0x655b59c3); \
+  MD5_MB_STEP(V_I, d, a, b, c,  3, 10, 0x8f0ccc92); \
+  MD5_MB_STEP(V_I, c, d, a, b, 10, 15, 0xffeff47d); \
+  MD5_MB_STEP(V_I, b, c, d, a,  1, 21, 0x85845dd1); \
+  MD5_MB_STEP(V_I, a, b, c, d,  8,  6, 0x6fa87e4f); \
+  MD5_MB_STEP(V_I, d, a, b, c, 15, 10, 0xfe2ce6e0); \
+  MD5_MB_STEP(V_I, c, d, a, b,  6, 15, 0xa3014314); \
+  MD5_MB_STEP(V_I, b, c, d, a, 13, 21, 0x4e0811a1); \
+  MD5_MB_STEP(V_I, a, b, c, d,  4,  6, 0xf7537e82); \
+  MD5_MB_STEP(V_I, d, a, b, c, 11, 10, 0xbd3af235); \
+  MD5_MB_STEP(V_I, c, d, a, b,  2, 15, 0x2ad7d2bb); \
+  MD5_MB_STEP(V_I, b, c, d, a,  9, 21, 0xeb86d391); \
+  V_STORE(state + 0 * LANES, V_ADD(a, V_LOAD(state + 0 * LANES))); \
+  V_STORE(state + 1 * LANES, V_ADD(b, V_LOAD(state + 1 * LANES))); \
+  V_STORE(state + 2 * LANES, V_ADD(c, V_LOAD(state + 2 * LANES))); \
+  V_STORE(state + 3 * LANES, V_ADD(d, V_LOAD(state + 3 * LANES)));
+
+/* eight lanes of AVX2 */
+#define LANES         8
+#define V             __m256i
+#define V_LOAD(p)     _mm256_loadu_si256((const __m256i*)(p))
+#define V_STORE(p, x) _mm256_storeu_si256((__m256i*)(p), x)
+#define V_SET1(k)     _mm256_set1_epi32((int)(k))
+#define V_ADD(x, y)   _mm256_add_epi32(x, y)
+#define V_ROL(x, n)   _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define V_F(x, y, z)  _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define V_G(x, y, z)  _mm256_xor_si256(y, _mm256_and_si256(z, _mm256_xor_si256(x, y)))
+#define V_H(x, y, z)  _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define V_I(x, y, z)  _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1))))
+
+/**
+ * Process one block of every lane with AVX2.
+ *
+ * @param state algorithm states as [4][8]
+ * @param words decoded blocks as [16][8]
+ */
+MD5_TARGET("avx2")
+static void md5_multi_avx2(unsigned *state, const unsigned *words) {
+  MD5_MB_KERNEL_BODY
+}
+
+#undef LANES
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_ROL
+#undef V_F
+#undef V_G
+#undef V_H
+#undef V_I
+
+/* sixteen lanes of AVX-512, with single instruction rotations and
+ * ternary logic for the round functions */
+#define LANES         16
+#define V             __m512i
+#define V_LOAD(p)     _mm512_loadu_si512((const void*)(p))
+#define V_STORE(p, x) _mm512_storeu_si512((void*)(p), x)
+#define V_SET1(k)     _mm512_set1_epi32((int)(k))
+#define V_ADD(x, y)   _mm512_add_epi32(x, y)
+#define V_ROL(x, n)   _mm512_rol_epi32(x, n)
+#define V_F(x, y, z)  _mm512_ternarylogic_epi32(x, y, z, 0xCA)
+#define V_G(x, y, z)  _mm512_ternarylogic_epi32(x, y, z, 0xE4)
+#define V_H(x, y, z)  _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define V_I(x, y, z)  _mm512_ternarylogic_epi32(x, y, z, 0x39)
+
+/**
+ * Process one block of every lane with AVX-512.
+ *
+ * @param state algorithm states as [4][16]
+ * @param words decoded blocks as [16][16]
+ */
+MD5_TARGET("avx512f")
+static void md5_multi_avx512(unsigned *state, const unsigned *words) {
+  MD5_MB_KERNEL_BODY
+}
+
+#undef LANES
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_ROL
+#undef V_F
+#undef V_G
+#undef V_H
+#undef V_I
+#undef MD5_MB_STEP
+#undef MD5_MB_KERNEL_BODY
+
+#define MD5_MAX_LANES 16
+
+/* a message assigned to a lane, with its padded tail kept aside */
+typedef struct md5_lane {
+  const unsigned char* msg;
+  size_t size;
+  unsigned char* result;
+  size_t block, full, blocks;
+  unsigned tail[32];
+} md5_lane;
+
+/**
+ * Start a message in a lane.
+ *
+ * @param lane the lane
+ * @param state algorithm states as [4][lanes]
+ * @param lanes the number of lanes
+ * @param l index of the lane
+ */
+static void md5_multi_assign(md5_lane* lane, unsigned *state, int lanes, int l,
+  const unsigned char* msg, size_t size, unsigned char* result) {
+  unsigned char* tail = (unsigned char*)lane->tail;
+  size_t rest;
+
+  lane->msg = msg;
+  lane->size = size;
+  lane->result = result;
+  state[0 * lanes + l] = 0x67452301;
+  state[1 * lanes + l] = 0xefcdab89;
+  state[2 * lanes + l] = 0x98badcfe;
+  state[3 * lanes + l] = 0x10325476;
+  /* whole blocks are read from the message, the rest and the padding from the tail */
+  lane->block = 0;
+  lane->full = size / md5_block_size;
+  rest = size % md5_block_size;
+  lane->blocks = lane->full + (rest < 56 ? 1 : 2);
+  memset(lane->tail, 0, sizeof(lane->tail));
+  memcpy(tail, msg + lane->full * md5_block_size, rest);
+  tail[rest] = 0x80;
+  /* the kernels are x86 only, so words are little-endian already */
+  lane->tail[(lane->blocks - lane->full) * 16 - 2] = (unsigned)((uint64_t)size << 3);
+  lane->tail[(lane->blocks - lane->full) * 16 - 1] = (unsigned)((uint64_t)size >> 29);
+}
+
+/**
+ * Hash messages side by side, lanes of messages already finished take on
+ * the following ones. The last few messages are finished one by one rather
+ * than in a mostly idle register.
+ *
+ * @param kernel block function of the lanes
+ * @param lanes the number of lanes
+ * @param msgs the messages
+ * @param sizes lengths of the messages
+ * @param results where digests are stored
+ * @param count the number of messages
+ */
+static void md5_multi_lanes_hash(void (*kernel)(unsigned*, const unsigned*), int lanes,
+  const unsigned char* const* msgs, const size_t* sizes, unsigned char* const* results,
+  size_t count) {
+  unsigned state[4 * MD5_MAX_LANES], words[16 * MD5_MAX_LANES];
+  md5_lane lane[MD5_MAX_LANES];
+  md5_ctx ctx;
+  size_t next = 0;
+  const unsigned char* p;
+  int active = 0, j, l;
+
+  for(l = 0; l < lanes; l++) {
+    if(next < count) {
+      md5_multi_assign(&lane[l], state, lanes, l, msgs[next], sizes[next], results[next]);
+      next++;
+      active++;
+    } else {
+      lane[l].msg = NULL;
+    }
+  }
+  memset(words, 0, sizeof(words));
+
+  while(active > 0 && (next < count || active * 2 > lanes)) {
+    for(l = 0; l < lanes; l++) {
+      if(lane[l].msg == NULL) continue;
+      p = (lane[l].block < lane[l].full) ? lane[l].msg + lane[l].block * md5_block_size
+        : (const unsigned char*)lane[l].tail + (lane[l].block - lane[l].full) * md5_block_size;
+      for(j = 0; j < 16; j++) {
+        memcpy(&words[j * lanes + l], p + 4 * j, 4);
+      }
+    }
+    kernel(state, words);
+    for(l = 0; l < lanes; l++) {
+      if(lane[l].msg == NULL || ++lane[l].block < lane[l].blocks) continue;
+      for(j = 0; j < 4; j++) {
+        memcpy(lane[l].result + 4 * j, &state[j * lanes + l], 4);
+      }
+      if(next < count) {
+        md5_multi_assign(&lane[l], state, lanes, l, msgs[next], sizes[next], results[next]);
+        next++;
+      } else {
+        lane[l].msg = NULL;
+        active--;
+      }
+    }
+  }
+
+  /* stragglers continue from their state in a regular context */
+  for(l = 0; l < lanes; l++) {
+    if(lane[l].msg == NULL) continue;
+    for(j = 0; j < 4; j++) {
+      ctx.state[j] = state[j * lanes + l];
+    }
+    if(lane[l].block <= lane[l].full) {
+      ctx.length = (uint64_t)lane[l].block * md5_block_size;
+      md5_update(&ctx, lane[l].msg + lane[l].block * md5_block_size,
+        (unsigned)(lane[l].size - lane[l].block * md5_block_size));
+      md5_final(&ctx, lane[l].result);
+    } else {
+      /* only the second block of the padding is left */
+      md5_process_message_block(ctx.state, lane[l].tail + 16);
+      memcpy(lane[l].result, ctx.state, 16);
+    }
+  }
+}
+#endif /* MD5_MULTI */
+
+#ifdef MD5_MULTI
+/* AVX-512 and AVX registers have to be saved by the system as well as
+ * supported by the CPU, xcr0 tells the former and ebx of leaf 7 the latter */
+#define MD5_SUPPORTED_LANES(xcr0, ebx) \
+  ((((xcr0) & 0xE6) == 0xE6 && ((ebx) & (1u << 16)) ? 16 : 0) | \
+   (((xcr0) & 6) == 6 && ((ebx) & (1u << 5)) ? 8 : 0))
+#endif
+
+/**
+ * Detect vector extensions of the CPU usable for multi-buffer hashing.
+ */
+static void md5_detect(void) {
+  int kernels = 0;
+#if defined(MD5_MULTI) && defined(__GNUC__)
+  unsigned eax, ebx, ecx, edx, xcr0, hi;
+  /* OSXSAVE and AVX */
+  if(__get_cpuid_max(0, NULL) >= 7 && __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+     (ecx & (1u << 27)) && (ecx & (1u << 28))) {
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(xcr0), "=d"(hi) : "c"(0));
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    kernels = MD5_SUPPORTED_LANES(xcr0, ebx);
+  }
+#elif defined(MD5_MULTI)
+  int info[4];
+  unsigned xcr0;
+  __cpuid(info, 0);
+  if(info[0] >= 7) {
+    __cpuid(info, 1);
+    if((info[2] & (1 << 27)) && (info[2] & (1 << 28))) {
+      xcr0 = (unsigned)_xgetbv(0);
+      __cpuidex(info, 7, 0);
+      kernels = MD5_SUPPORTED_LANES(xcr0, (unsigned)info[1]);
+    }
+  }
+#endif
+  md5Kernels = kernels;
+  md5Lanes = (kernels & 16) ? 16 : (kernels & 8) ? 8 : 0;
+}
+
+/**
+ * Tell how many messages md5_multi hashes side by side on this CPU.
+ *
+ * @return the number of lanes, 0 if messages are hashed one by one
+ */
+int md5_multi_lanes(void) {
+  if(md5Lanes < 0) md5_detect();
+  return md5Lanes;
+}
+
+/**
+ * Select the kernel of md5_multi by its number of lanes, for tests mostly.
+ *
+ * @param lanes 16 or 8 for a kernel of that width, 0 to hash messages one by one
+ * @return the number of lanes selected, 0 if the CPU lacks the kernel
+ */
+int md5_multi_select(int lanes) {
+  if(md5Lanes < 0) md5_detect();
+  md5Lanes = ((lanes == 16 || lanes == 8) && (md5Kernels & lanes)) ? lanes : 0;
+  return md5Lanes;
+}
+
+/**
+ * Calculate MD5 of several independent messages at once. Each digest is
+ * the one md5_init, md5_update and md5_final give for the message alone.
+ *
+ * @param msgs the messages
+ * @param sizes lengths of the messages
+ * @param results where digests are stored, 16 bytes each
+ * @param count the number of messages
+ */
+void md5_multi(const unsigned char* const* msgs, const size_t* sizes,
+  unsigned char* const* results, size_t count) {
+  md5_ctx ctx;
+  size_t i;
+  int lanes;
+
+  if(md5Lanes < 0) md5_detect();
+  /* read once, the kernel and its width must agree */
+  lanes = md5Lanes;
+#ifdef MD5_MULTI
+  if(lanes > 0 && count > 1) {
+    md5_multi_lanes_hash(lanes == 16 ? md5_multi_avx512 : md5_multi_avx2,
+      lanes, msgs, sizes, results, count);
+    return;
+  }
+#endif
+  for(i = 0; i < count; i++) {
+    md5_init(&ctx);
+    md5_update(&ctx, msgs[i], (unsigned)sizes[i]);
+    md5_final(&ctx, results[i]);
+  }
+}
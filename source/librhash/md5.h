@@ -2,6 +2,7 @@
 #ifndef MD5_HIDER
 #define MD5_HIDER
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +20,10 @@ typedef struct md5_ctx {
 void md5_init(md5_ctx *ctx);
 void md5_update(md5_ctx *ctx, const unsigned char* msg, unsigned size);
 void md5_final(md5_ctx *ctx, unsigned char result[16]);
+int md5_multi_lanes(void);
+int md5_multi_select(int lanes);
+void md5_multi(const unsigned char* const* msgs, const size_t* sizes,
+  unsigned char* const* results, size_t count);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -7,6 +7,29 @@
 #include "byte_order.h"
 #include "sha1.h"
 
+/* SHA extensions kernel is compiled for x86 with compilers able to
+ * target single functions, so the rest of the library needs no extra flags */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define SHA1_SHANI
+# define SHA1_TARGET __attribute__((target("sha,sse4.1")))
+# include <cpuid.h>
+#elif defined(_MSC_VER) && (_MSC_VER >= 1900) && (defined(_M_X64) || defined(_M_IX86))
+# define SHA1_SHANI
+# define SHA1_TARGET
+# include <intrin.h>
+#endif
+
+#ifdef SHA1_SHANI
+# include <emmintrin.h>
+# include <tmmintrin.h>
+# include <smmintrin.h>
+# include <immintrin.h>
+#endif
+
+/* 1 if the CPU has SHA extensions, -1 until detected */
+static int sha1ShaNi = -1;
+
 void sha1_init(sha1_ctx *ctx) {
   ctx->length = 0;
 
@@ -88,6 +111,154 @@ static void sha1_process_message_block(unsigned *state, const unsigned* block) {
     state[4] += E;
 }
 
+#ifdef SHA1_SHANI
+/* four rounds, e is E of the previous group of rounds and becomes that of this one */
+#define SHA1_ROUNDS4(e, e_next, w, f) \
+    e = _mm_sha1nexte_epu32(e, w); \
+    e_next = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+/* W[t..t+3] in place of W[t-16..t-13] */
+#define SHA1_SCHEDULE(w0, w1, w2, w3) \
+    w0 = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w0, w1), w2), w3);
+
+/**
+ * Process 64 byte blocks of a message with SHA extensions.
+ *
+ * @param state algorithm state
+ * @param msg the message, no alignment required
+ * @param count the number of blocks
+ */
+SHA1_TARGET
+static void sha1_process_shani(unsigned *state, const unsigned char* msg, size_t count) {
+  const __m128i swap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+  __m128i abcd, e0, e1, abcd_save, e0_save, w0, w1, w2, w3;
+
+  /* A is kept in the highest word, as the instructions expect */
+  abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+  e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+  for(; count>0; count--, msg+=sha1_block_size) {
+    abcd_save = abcd;
+    e0_save = e0;
+    w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg +  0)), swap);
+    w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 16)), swap);
+    w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 32)), swap);
+    w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(msg + 48)), swap);
+
+    e0 = _mm_add_epi32(e0, w0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    SHA1_ROUNDS4(e1, e0, w1, 0);
+    SHA1_ROUNDS4(e0, e1, w2, 0);
+    SHA1_ROUNDS4(e1, e0, w3, 0);
+    SHA1_SCHEDULE(w0, w1, w2, w3); SHA1_ROUNDS4(e0, e1, w0, 0);
+    SHA1_SCHEDULE(w1, w2, w3, w0); SHA1_ROUNDS4(e1, e0, w1, 1);
+    SHA1_SCHEDULE(w2, w3, w0, w1); SHA1_ROUNDS4(e0, e1, w2, 1);
+    SHA1_SCHEDULE(w3, w0, w1, w2); SHA1_ROUNDS4(e1, e0, w3, 1);
+    SHA1_SCHEDULE(w0, w1, w2, w3); SHA1_ROUNDS4(e0, e1, w0, 1);
+    SHA1_SCHEDULE(w1, w2, w3, w0); SHA1_ROUNDS4(e1, e0, w1, 1);
+    SHA1_SCHEDULE(w2, w3, w0, w1); SHA1_ROUNDS4(e0, e1, w2, 2);
+    SHA1_SCHEDULE(w3, w0, w1, w2); SHA1_ROUNDS4(e1, e0, w3, 2);
+    SHA1_SCHEDULE(w0, w1, w2, w3); SHA1_ROUNDS4(e0, e1, w0, 2);
+    SHA1_SCHEDULE(w1, w2, w3, w0); SHA1_ROUNDS4(e1, e0, w1, 2);
+    SHA1_SCHEDULE(w2, w3, w0, w1); SHA1_ROUNDS4(e0, e1, w2, 2);
+    SHA1_SCHEDULE(w3, w0, w1, w2); SHA1_ROUNDS4(e1, e0, w3, 3);
+    SHA1_SCHEDULE(w0, w1, w2, w3); SHA1_ROUNDS4(e0, e1, w0, 3);
+    SHA1_SCHEDULE(w1, w2, w3, w0); SHA1_ROUNDS4(e1, e0, w1, 3);
+    SHA1_SCHEDULE(w2, w3, w0, w1); SHA1_ROUNDS4(e0, e1, w2, 3);
+    SHA1_SCHEDULE(w3, w0, w1, w2); SHA1_ROUNDS4(e1, e0, w3, 3);
+
+    /* E of the block is derived from A four rounds before the end */
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = (unsigned)_mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_ROUNDS4
+#undef SHA1_SCHEDULE
+#endif /* SHA1_SHANI */
+
+/**
+ * Detect SHA extensions of the CPU.
+ */
+static void sha1_detect(void) {
+#if defined(SHA1_SHANI) && defined(__GNUC__)
+  unsigned eax, ebx, ecx, edx;
+  int found = 0;
+  if(__get_cpuid_max(0, NULL) >= 7 && __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+     (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    found = (ebx & (1u << 29)) ? 1 : 0;
+  }
+  sha1ShaNi = found;
+#elif defined(SHA1_SHANI)
+  int info[4];
+  int found = 0;
+  __cpuid(info, 0);
+  if(info[0] >= 7) {
+    __cpuid(info, 1);
+    if((info[2] & (1 << 9)) && (info[2] & (1 << 19))) {
+      __cpuidex(info, 7, 0);
+      found = (info[1] & (1 << 29)) ? 1 : 0;
+    }
+  }
+  sha1ShaNi = found;
+#else
+  sha1ShaNi = 0;
+#endif
+}
+
+#ifdef __GNUC__
+/* the kernel is known before any thread may hash, other compilers detect it
+ * with the first block, which stores the same value if threads race */
+static void sha1_detect_early(void) __attribute__((constructor));
+static void sha1_detect_early(void) {
+  sha1_detect();
+}
+#endif
+
+/**
+ * Process consecutive 64 byte blocks with the fastest kernel the CPU supports.
+ *
+ * @param state algorithm state
+ * @param msg the message
+ * @param count the number of blocks
+ */
+static void sha1_process_blocks(unsigned *state, const unsigned char* msg, size_t count) {
+  if(sha1ShaNi < 0) sha1_detect();
+#ifdef SHA1_SHANI
+  if(sha1ShaNi) {
+    sha1_process_shani(state, msg, count);
+    return;
+  }
+#endif
+  for(; count>0; count--, msg+=sha1_block_size) {
+    if( IS_ALIGNED_32(msg) ) {
+      /* the most common case is processing of an already aligned message
+         without copying it */
+      sha1_process_message_block(state, (const unsigned*)msg);
+    } else {
+      unsigned block[sha1_block_size/4];
+      memcpy(block, msg, sha1_block_size);
+      sha1_process_message_block(state, block);
+    }
+  }
+}
+
+/**
+ * Tell whether SHA1 blocks are compressed with x86 SHA extensions.
+ *
+ * @return 1 if they are, 0 if the portable code is used
+ */
+int sha1_accelerated(void) {
+  if(sha1ShaNi < 0) sha1_detect();
+  return sha1ShaNi;
+}
+
 void sha1_update(sha1_ctx *ctx, const unsigned char* msg, unsigned size) {
   unsigned index = (unsigned)ctx->length & 63;
   unsigned left;
@@ -101,23 +272,16 @@ void sha1_update(sha1_ctx *ctx, const unsigned char* msg, unsigned size) {
       return;
     } else {
       memcpy(ctx->message + index, msg, left);
-      sha1_process_message_block(ctx->state, (unsigned*)ctx->message);
+      sha1_process_blocks(ctx->state, ctx->message, 1);
       msg += left;
       size -= left;
     }
   }
-  while (size >= sha1_block_size) {
-    if( IS_ALIGNED_32(msg) ) {
-      /* the most common case is processing of an already aligned message 
-         without copying it */
-      sha1_process_message_block(ctx->state, (unsigned*)msg);
-    } else {
-      memcpy(ctx->message, msg, sha1_block_size);
-      sha1_process_message_block(ctx->state, (unsigned*)ctx->message);
-    }
-
-    msg += sha1_block_size;
-    size -= sha1_block_size;
+  if (size >= sha1_block_size) {
+    /* whole blocks are passed at once, so the kernel keeps its state in registers */
+    sha1_process_blocks(ctx->state, msg, size / sha1_block_size);
+    msg += size & ~(sha1_block_size - 1);
+    size &= sha1_block_size - 1;
   }
   if(size) {
     /* save leftovers */
@@ -137,7 +301,7 @@ void sha1_final(sha1_ctx *ctx, unsigned char result[20]) {
     while(index < 64) {
       ctx->message[index++] = 0;
     }
-    sha1_process_message_block(ctx->state, (unsigned*)ctx->message);
+    sha1_process_blocks(ctx->state, ctx->message, 1);
     index = 0;
   }
   while(index < 56) {
@@ -146,7 +310,7 @@ void sha1_final(sha1_ctx *ctx, unsigned char result[20]) {
   ((unsigned*)ctx->message)[14] = be2me_32( (unsigned)(ctx->length >> 29) );
   ((unsigned*)ctx->message)[15] = be2me_32( (unsigned)(ctx->length << 3) );
 
-  sha1_process_message_block(ctx->state, (unsigned*)ctx->message);
+  sha1_process_blocks(ctx->state, ctx->message, 1);
 
   be32_copy(result, &ctx->state, 20);
 }
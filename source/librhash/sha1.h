@@ -19,6 +19,7 @@ typedef struct sha1_ctx {
 void sha1_init(sha1_ctx *ctx);
 void sha1_update(sha1_ctx *ctx, const unsigned char* msg, unsigned size);
 void sha1_final(sha1_ctx *ctx, unsigned char result[20]);
+int sha1_accelerated(void);
 
 #ifdef __cplusplus
 } /* extern "C" */
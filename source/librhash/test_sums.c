@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include "crc_sums.h"
+#include "crc32.h"
+#include "md5.h"
 
 /************************************************************************
  *                         Data for tests
@@ -200,6 +202,177 @@ static void test_alignment(void) {
   }
 }
 
+/* check table and folding kernels of crc32 against a bitwise implementation,
+ * at lengths and alignments where the kernels hand over to each other; the
+ * table kernel is checked alone too, as folding takes every long message */
+static void test_crc32_kernels(void) {
+  static unsigned char message[1024 + 16];
+  int i, k, start, length, pclmul;
+
+  for(i=0; i<(int)sizeof(message); i++) message[i] = (unsigned char)(i * 131 + (i >> 5));
+  for(pclmul=0; pclmul<2; pclmul++) {
+    if(crc32_select(pclmul) != pclmul) {
+      printf("CRC32 carry-less multiplication kernel skipped, not supported by this CPU\n");
+      continue;
+    }
+    for(start=0; start<16; start++) {
+      for(length=0; length<=1024; length += (length < 160 ? 1 : 61)) {
+        unsigned expected = 0xFFFFFFFF, obtained;
+        char hash_expected[10], hash_obtained[10], name[40];
+        for(i=0; i<length; i++) {
+          expected ^= message[start + i];
+          for(k=0; k<8; k++) expected = (expected >> 1) ^ (0xEDB88320 & (0 - (expected & 1)));
+        }
+        expected ^= 0xFFFFFFFF;
+        /* split in two, so the second part starts unaligned */
+        obtained = get_crc32(0, (const char*)message + start, length / 3);
+        obtained = get_crc32(obtained, (const char*)message + start + length / 3, length - length / 3);
+        sprintf(hash_expected, "%08X", expected);
+        sprintf(hash_obtained, "%08X", obtained);
+        sprintf(name, "%d bytes at offset %d, %s", length, start, pclmul ? "pclmul" : "tables");
+        assert_equals(hash_obtained, hash_expected, "CRC32", name);
+        /* parts hashed separately and combined */
+        obtained = crc32_combine(get_crc32(0, (const char*)message + start, length / 3),
+          get_crc32(0, (const char*)message + start + length / 3, length - length / 3),
+          length - length / 3);
+        sprintf(hash_obtained, "%08X", obtained);
+        assert_equals(hash_obtained, hash_expected, "CRC32 combined", name);
+      }
+    }
+  }
+  crc32_select(1);
+}
+
+/* feed a TTH context the way parallel hashing does: a partial leaf is
+ * completed first, whole leaves go by subtrees of at most 2^max_level leaves
+ * aligned to the leaf count, and the rest follows as usual */
+static void tth_update_by_subtrees(tth_ctx *ctx, const unsigned char* msg, unsigned size,
+  unsigned max_level) {
+  unsigned char root[24];
+  unsigned head, leaves, level;
+  uint64_t count;
+
+  if(!tth_on_leaf_boundary(ctx)) {
+    head = 1025 - (unsigned)ctx->tiger.length;
+    if(head > size) head = size;
+    tth_update(ctx, msg, head);
+    msg += head;
+    size -= head;
+  }
+  leaves = size / 1024;
+  count = ctx->block_count;
+  while(leaves > 0) {
+    level = max_level;
+    while((count & (((uint64_t)1 << level) - 1)) || (1u << level) > leaves) level--;
+    tth_subtree(msg, level, root);
+    tth_merge_subtree(ctx, root, level);
+    msg += 1024u << level;
+    count += (uint64_t)1 << level;
+    leaves -= 1u << level;
+  }
+  tth_update(ctx, msg, size % 1024);
+}
+
+/* check TTH of data fed by subtrees against the same data fed sequentially,
+ * at lengths around leaf boundaries and after prefixes that leave a partial
+ * leaf or a leaf count that is not a power of two */
+static void test_tth_subtrees(void) {
+  static unsigned char message[40 * 1024];
+  static const unsigned prefixes[] = { 0, 1, 1023, 1024, 3*1024, 3*1024 + 17, 5*1024, 6*1024 + 1023 };
+  static const unsigned lengths[] = { 0, 1, 1023, 1024, 1025, 2047, 2048, 2049, 3*1024 + 1,
+    7*1024, 13*1024 + 5, 31*1024 };
+  /* tth_final is declared with room for 64 bytes, of which it fills 24 */
+  unsigned char expected[64], obtained[64];
+  tth_ctx ctx;
+  int i, j, k;
+  unsigned max_level;
+
+  for(i=0; i<(int)sizeof(message); i++) message[i] = (unsigned char)(i * 11 + (i >> 9));
+  for(i=0; i<(int)(sizeof(prefixes)/sizeof(prefixes[0])); i++) {
+    for(j=0; j<(int)(sizeof(lengths)/sizeof(lengths[0])); j++) {
+      tth_init(&ctx);
+      tth_update(&ctx, message, prefixes[i] + lengths[j]);
+      tth_final(&ctx, expected);
+      for(max_level=0; max_level<5; max_level++) {
+        char hash_expected[49], hash_obtained[49], name[60];
+        tth_init(&ctx);
+        tth_update(&ctx, message, prefixes[i]);
+        tth_update_by_subtrees(&ctx, message + prefixes[i], lengths[j], max_level);
+        tth_final(&ctx, obtained);
+        for(k=0; k<24; k++) {
+          sprintf(hash_expected + 2 * k, "%02X", expected[k]);
+          sprintf(hash_obtained + 2 * k, "%02X", obtained[k]);
+        }
+        sprintf(name, "%u bytes after %u, subtrees up to 2^%u", lengths[j], prefixes[i], max_level);
+        assert_equals(hash_obtained, hash_expected, "TTH subtrees", name);
+      }
+    }
+  }
+}
+
+/* check SHA1 of a million 'a' fed in pieces that leave partial blocks behind,
+ * from unaligned addresses, so single and consecutive blocks reach the kernel */
+static void test_sha1_blocks(void) {
+  static char message[4097 + 4];
+  static const int pieces[] = { 1, 63, 65, 1000, 4097 };
+  int i, start;
+
+  memset(message, 'a', sizeof(message));
+  for(start=0; start<4; start++) {
+    for(i=0; i<(int)(sizeof(pieces)/sizeof(pieces[0])); i++) {
+      char name[40];
+      sprintf(name, "1000000 'a' by %d at offset %d", pieces[i], start);
+      assert_equals(sum_to_text(calc_sums_c(message + start, pieces[i], 1000000, FLAG_SHA1), FLAG_SHA1),
+        "34AA973CD4C4DAA4F61EEB2BDBAD27316534016F", "SHA1", name);
+    }
+  }
+}
+
+/* check MD5 of messages hashed side by side against the same messages hashed
+ * one by one, at lengths around the padding boundaries, in groups of sizes
+ * that leave lanes idle, refill them and finish stragglers one by one */
+static void test_md5_multi(void) {
+  static unsigned char message[300 + 4];
+  static const int groups[] = { 2, 3, 17, 40 };
+  static const int widths[] = { 8, 16 };
+  const int lanes = md5_multi_lanes();
+  const unsigned char* msgs[40];
+  size_t sizes[40];
+  unsigned char digests[40][16], expected[16];
+  unsigned char* results[40];
+  md5_ctx ctx;
+  int i, g, k, w;
+
+  for(i=0; i<(int)sizeof(message); i++) message[i] = (unsigned char)(i * 7 + 3);
+  for(w=0; w<(int)(sizeof(widths)/sizeof(widths[0])); w++) {
+    if(md5_multi_select(widths[w]) != widths[w]) {
+      printf("MD5 %d lanes skipped, not supported by this CPU\n", widths[w]);
+      continue;
+    }
+    for(g=0; g<(int)(sizeof(groups)/sizeof(groups[0])); g++) {
+      for(i=0; i<groups[g]; i++) {
+        msgs[i] = message + (i & 3);
+        sizes[i] = (size_t)((i * 37 + g * 11 + 55) % 300);
+        results[i] = digests[i];
+      }
+      md5_multi(msgs, sizes, results, (size_t)groups[g]);
+      for(i=0; i<groups[g]; i++) {
+        char hash_expected[33], hash_obtained[33], name[48];
+        md5_init(&ctx);
+        md5_update(&ctx, msgs[i], (unsigned)sizes[i]);
+        md5_final(&ctx, expected);
+        for(k=0; k<16; k++) {
+          sprintf(hash_expected + 2 * k, "%02X", expected[k]);
+          sprintf(hash_obtained + 2 * k, "%02X", digests[i][k]);
+        }
+        sprintf(name, "%d bytes, %d of %d, %d lanes", (int)sizes[i], i, groups[g], widths[w]);
+        assert_equals(hash_obtained, hash_expected, "MD5 multi", name);
+      }
+    }
+  }
+  md5_multi_select(lanes);
+}
+
 static double fsec(struct timeval *delta) {
   return ((double)delta->tv_usec/1000000.0)+delta->tv_sec;
 }
@@ -252,6 +425,10 @@ int main(int argc, char *argv[]) {
 
   test_known_strings();
   test_alignment();
+  test_crc32_kernels();
+  test_tth_subtrees();
+  test_sha1_blocks();
+  test_md5_multi();
   if(n_errors==0) printf("All sums are working properly!\n");
   fflush(stdout);
 
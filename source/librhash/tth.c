@@ -54,6 +54,39 @@ void tth_update(tth_ctx *ctx, const unsigned char* msg, unsigned size) {
   }
 }
 
+/* hash 2^level whole leaves into the root of their subtree */
+void tth_subtree(const unsigned char* msg, unsigned level, unsigned char root[24]) {
+  tth_ctx ctx;
+  tth_init(&ctx);
+  tth_update(&ctx, msg, 1024u << level);
+  /* all lower levels are merged, the only stack entry left is the root */
+  memcpy(root, ctx.stack + 3*level, 24);
+}
+
+/* add a subtree root as if its 2^level leaves were hashed by tth_update,
+   ctx must be on a leaf boundary with block_count a multiple of 2^level */
+void tth_merge_subtree(tth_ctx *ctx, const unsigned char root[24], unsigned level) {
+  uint64_t it;
+  unsigned pos = 3*level;
+  unsigned char msg[24];
+  memcpy(msg, root, 24);
+  for(it = (uint64_t)1 << level; it & ctx->block_count; it <<= 1) {
+    tiger_init(&ctx->tiger);
+    ctx->tiger.message[ ctx->tiger.length++ ] = 1;
+    tiger_update(&ctx->tiger, (unsigned char*)(ctx->stack + pos), 24);
+    tiger_update(&ctx->tiger, msg, 24);
+    tiger_final(&ctx->tiger, msg);
+    bswap_3x64(msg);
+    pos += 3;
+  }
+  memcpy(ctx->stack + pos, msg, 24);
+  ctx->block_count += (uint64_t)1 << level;
+
+  /* init block hash */
+  tiger_init(&ctx->tiger);
+  ctx->tiger.message[ ctx->tiger.length++ ] = 0;
+}
+
 /* get tth root hash */
 void tth_final(tth_ctx *ctx, unsigned char result[24]) {
   uint64_t it = 1;
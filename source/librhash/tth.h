@@ -17,6 +17,11 @@ typedef struct tth_ctx {
 void tth_init(tth_ctx *ctx);
 void tth_update(tth_ctx *ctx, const unsigned char* msg, unsigned size);
 void tth_final(tth_ctx *ctx, unsigned char result[64]);
+void tth_subtree(const unsigned char* msg, unsigned level, unsigned char root[24]);
+void tth_merge_subtree(tth_ctx *ctx, const unsigned char root[24], unsigned level);
+
+/* true if ctx has no partial leaf, so whole subtrees may be merged into it */
+#define tth_on_leaf_boundary(ctx) ((ctx)->tiger.length == 1)
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -35,7 +35,7 @@ const struct ltc_hash_descriptor sha256_desc =
     NULL
 };
 
-#ifdef LTC_SMALL_CODE
+#if defined(LTC_SMALL_CODE) || defined(LTC_X86_KERNELS)
 /* the K array */
 static const ulong32 K[64] = {
     0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
@@ -198,6 +198,238 @@ static int sha256_compress(hash_state * md, unsigned char *buf)
 }
 #endif
 
+/* compress consecutive blocks, the portable code is the reference for the kernels below */
+static void sha256_blocks_c(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    for (; blocks > 0; blocks--, buf += 64) {
+        sha256_compress(md, (unsigned char *)buf);
+    }
+}
+
+#ifdef LTC_X86_KERNELS
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
+
+/* rounds of the scalar kernels, x is W[i] + K[i] taken from the vector schedule */
+#define RNDX(a,b,c,d,e,f,g,h,x)                     \
+     t0 = h + Sigma1(e) + Ch(e, f, g) + (x);        \
+     t1 = Sigma0(a) + Maj(a, b, c);                 \
+     d += t0;                                       \
+     h  = t0 + t1;
+
+/* 64 rounds of a block, WK(i) names W[i] + K[i] */
+#define SHA256_ROUNDS(WK)                                   \
+    a = md->sha256.state[0]; b = md->sha256.state[1];       \
+    c = md->sha256.state[2]; d = md->sha256.state[3];       \
+    e = md->sha256.state[4]; f = md->sha256.state[5];       \
+    g = md->sha256.state[6]; h = md->sha256.state[7];       \
+    for (i = 0; i < 64; i += 8) {                           \
+        RNDX(a,b,c,d,e,f,g,h,WK(i+0));                      \
+        RNDX(h,a,b,c,d,e,f,g,WK(i+1));                      \
+        RNDX(g,h,a,b,c,d,e,f,WK(i+2));                      \
+        RNDX(f,g,h,a,b,c,d,e,WK(i+3));                      \
+        RNDX(e,f,g,h,a,b,c,d,WK(i+4));                      \
+        RNDX(d,e,f,g,h,a,b,c,WK(i+5));                      \
+        RNDX(c,d,e,f,g,h,a,b,WK(i+6));                      \
+        RNDX(b,c,d,e,f,g,h,a,WK(i+7));                      \
+    }                                                       \
+    md->sha256.state[0] += a; md->sha256.state[1] += b;     \
+    md->sha256.state[2] += c; md->sha256.state[3] += d;     \
+    md->sha256.state[4] += e; md->sha256.state[5] += f;     \
+    md->sha256.state[6] += g; md->sha256.state[7] += h;
+
+/* four (eight with AVX2) schedule words at a time, the AVX2 forms work on
+   each 128-bit lane separately so a register carries two blocks side by side */
+#define ROR128(x, n)   _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define GAMMA0_128(x)  _mm_xor_si128(_mm_xor_si128(ROR128(x, 7), ROR128(x, 18)), _mm_srli_epi32(x, 3))
+#define GAMMA1_128(x)  _mm_xor_si128(_mm_xor_si128(ROR128(x, 17), ROR128(x, 19)), _mm_srli_epi32(x, 10))
+#define ROR256(x, n)   _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define GAMMA0_256(x)  _mm256_xor_si256(_mm256_xor_si256(ROR256(x, 7), ROR256(x, 18)), _mm256_srli_epi32(x, 3))
+#define GAMMA1_256(x)  _mm256_xor_si256(_mm256_xor_si256(ROR256(x, 17), ROR256(x, 19)), _mm256_srli_epi32(x, 10))
+
+/* W[t..t+3] are computed in place of W[t-16..t-13]; Gamma1 needs W[t] and W[t+1]
+   of the same group, so the upper half is finished after the lower one */
+LTC_TARGET("ssse3")
+static void sha256_blocks_ssse3(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    ulong32 wk[64], a, b, c, d, e, f, g, h, t0, t1;
+    __m128i w[4];
+    int i;
+
+    for (; blocks > 0; blocks--, buf += 64) {
+        for (i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16*i)), swap);
+            _mm_storeu_si128((__m128i *)(wk + 4*i), _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i *)(K + 4*i))));
+        }
+        for (i = 4; i < 16; i++) {
+            __m128i *x = &w[i & 3];
+            *x = _mm_add_epi32(*x, GAMMA0_128(_mm_alignr_epi8(w[(i+1) & 3], *x, 4)));
+            *x = _mm_add_epi32(*x, _mm_alignr_epi8(w[(i+3) & 3], w[(i+2) & 3], 4));
+            *x = _mm_add_epi32(*x, GAMMA1_128(_mm_srli_si128(w[(i+3) & 3], 8)));
+            *x = _mm_add_epi32(*x, GAMMA1_128(_mm_slli_si128(*x, 8)));
+            _mm_storeu_si128((__m128i *)(wk + 4*i), _mm_add_epi32(*x, _mm_loadu_si128((const __m128i *)(K + 4*i))));
+        }
+#define WK(i) wk[i]
+        SHA256_ROUNDS(WK)
+#undef WK
+    }
+#ifdef LTC_CLEAN_STACK
+    zeromem(wk, sizeof(wk));
+#endif
+}
+
+LTC_TARGET("avx2")
+static void sha256_blocks_avx2(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    const __m256i swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                         12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    /* groups of four words of the first block are followed by those of the second one */
+    ulong32 wk[128], a, b, c, d, e, f, g, h, t0, t1;
+    __m256i w[4], k;
+    int i;
+
+    for (; blocks > 1; blocks -= 2, buf += 128) {
+        for (i = 0; i < 4; i++) {
+            w[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(buf + 16*i))),
+                                           _mm_loadu_si128((const __m128i *)(buf + 64 + 16*i)), 1);
+            w[i] = _mm256_shuffle_epi8(w[i], swap);
+            k = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(K + 4*i)));
+            _mm256_storeu_si256((__m256i *)(wk + 8*i), _mm256_add_epi32(w[i], k));
+        }
+        for (i = 4; i < 16; i++) {
+            __m256i *x = &w[i & 3];
+            *x = _mm256_add_epi32(*x, GAMMA0_256(_mm256_alignr_epi8(w[(i+1) & 3], *x, 4)));
+            *x = _mm256_add_epi32(*x, _mm256_alignr_epi8(w[(i+3) & 3], w[(i+2) & 3], 4));
+            *x = _mm256_add_epi32(*x, GAMMA1_256(_mm256_srli_si256(w[(i+3) & 3], 8)));
+            *x = _mm256_add_epi32(*x, GAMMA1_256(_mm256_slli_si256(*x, 8)));
+            k = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(K + 4*i)));
+            _mm256_storeu_si256((__m256i *)(wk + 8*i), _mm256_add_epi32(*x, k));
+        }
+#define WK(i) wk[((i) & ~3) * 2 + ((i) & 3)]
+        SHA256_ROUNDS(WK)
+#undef WK
+#define WK(i) wk[((i) & ~3) * 2 + 4 + ((i) & 3)]
+        SHA256_ROUNDS(WK)
+#undef WK
+    }
+#ifdef LTC_CLEAN_STACK
+    zeromem(wk, sizeof(wk));
+#endif
+    if (blocks > 0) {
+        sha256_blocks_ssse3(md, buf, blocks);
+    }
+}
+
+#undef RNDX
+#undef SHA256_ROUNDS
+#undef ROR128
+#undef GAMMA0_128
+#undef GAMMA1_128
+#undef ROR256
+#undef GAMMA0_256
+#undef GAMMA1_256
+
+/* four rounds with SHA extensions, state halves are kept as ABEF and CDGH */
+#define SHA_ROUNDS4(msg, i)                                                          \
+    t = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *)(K + 4*(i))));            \
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, t);                                      \
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(t, 0x0E));
+
+/* W[t..t+3] into w0 = W[t-16..t-13], from w1, w2 and w3 that follow it */
+#define SHA_SCHEDULE(w0, w1, w2, w3)                                                 \
+    w0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1),            \
+                                            _mm_alignr_epi8(w3, w2, 4)), w3);
+
+LTC_TARGET("sha,sse4.1")
+static void sha256_blocks_sha(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m128i abef, cdgh, abef_save, cdgh_save, w0, w1, w2, w3, t;
+
+    t    = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(md->sha256.state + 0)), 0xB1); /* CDAB */
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(md->sha256.state + 4)), 0x1B); /* EFGH */
+    abef = _mm_alignr_epi8(t, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, t, 0xF0);
+
+    for (; blocks > 0; blocks--, buf += 64) {
+        abef_save = abef;
+        cdgh_save = cdgh;
+        w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf +  0)), swap);
+        w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), swap);
+        w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), swap);
+        w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), swap);
+        SHA_ROUNDS4(w0, 0);
+        SHA_ROUNDS4(w1, 1);
+        SHA_ROUNDS4(w2, 2);
+        SHA_ROUNDS4(w3, 3);
+        SHA_SCHEDULE(w0, w1, w2, w3); SHA_ROUNDS4(w0, 4);
+        SHA_SCHEDULE(w1, w2, w3, w0); SHA_ROUNDS4(w1, 5);
+        SHA_SCHEDULE(w2, w3, w0, w1); SHA_ROUNDS4(w2, 6);
+        SHA_SCHEDULE(w3, w0, w1, w2); SHA_ROUNDS4(w3, 7);
+        SHA_SCHEDULE(w0, w1, w2, w3); SHA_ROUNDS4(w0, 8);
+        SHA_SCHEDULE(w1, w2, w3, w0); SHA_ROUNDS4(w1, 9);
+        SHA_SCHEDULE(w2, w3, w0, w1); SHA_ROUNDS4(w2, 10);
+        SHA_SCHEDULE(w3, w0, w1, w2); SHA_ROUNDS4(w3, 11);
+        SHA_SCHEDULE(w0, w1, w2, w3); SHA_ROUNDS4(w0, 12);
+        SHA_SCHEDULE(w1, w2, w3, w0); SHA_ROUNDS4(w1, 13);
+        SHA_SCHEDULE(w2, w3, w0, w1); SHA_ROUNDS4(w2, 14);
+        SHA_SCHEDULE(w3, w0, w1, w2); SHA_ROUNDS4(w3, 15);
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+    }
+
+    t    = _mm_shuffle_epi32(abef, 0x1B);                 /* FEBA */
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);                 /* DCHG */
+    _mm_storeu_si128((__m128i *)(md->sha256.state + 0), _mm_blend_epi16(t, cdgh, 0xF0)); /* DCBA */
+    _mm_storeu_si128((__m128i *)(md->sha256.state + 4), _mm_alignr_epi8(cdgh, t, 8));    /* HGFE */
+}
+
+#undef SHA_ROUNDS4
+#undef SHA_SCHEDULE
+#endif /* LTC_X86_KERNELS */
+
+static void sha256_blocks_first(hash_state * md, const unsigned char *buf, unsigned long blocks);
+
+/* the kernel in use, chosen by the first call unless selected before */
+static void (*sha256_blocks)(hash_state * md, const unsigned char *buf, unsigned long blocks) = sha256_blocks_first;
+
+static void sha256_blocks_first(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    ltc_sha256_select(ltc_cpu_features());
+    sha256_blocks(md, buf, blocks);
+}
+
+/**
+   Select the compression kernel of SHA-256 and SHA-224, the portable code is used
+   where the CPU lacks all extensions of the others.  Threads racing through this
+   store the same kernel.
+   @param features  Extensions allowed, usually ltc_cpu_features(), 0 for the portable code
+   @return The LTC_CPU_* flag of the selected kernel, 0 for the portable code
+*/
+int ltc_sha256_select(int features)
+{
+#ifdef LTC_X86_KERNELS
+    if ((features & LTC_CPU_SHA) && (features & LTC_CPU_SSE41)) {
+       sha256_blocks = sha256_blocks_sha;
+       return LTC_CPU_SHA;
+    }
+    if ((features & LTC_CPU_AVX2) && (features & LTC_CPU_SSSE3)) {
+       sha256_blocks = sha256_blocks_avx2;
+       return LTC_CPU_AVX2;
+    }
+    if (features & LTC_CPU_SSSE3) {
+       sha256_blocks = sha256_blocks_ssse3;
+       return LTC_CPU_SSSE3;
+    }
+#endif
+    (void)features;
+    sha256_blocks = sha256_blocks_c;
+    return 0;
+}
+
 /**
    Initialize the hash state
    @param md   The hash state you wish to initialize
@@ -227,7 +459,37 @@ int ltc_sha256_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(ltc_sha256_process, sha256_compress, sha256, 64)
+int ltc_sha256_process(hash_state * md, const unsigned char *in, unsigned long inlen)
+{
+    unsigned long n;
+    LTC_ARGCHK(md != NULL);
+    LTC_ARGCHK(in != NULL);
+    if (md->sha256.curlen > sizeof(md->sha256.buf)) {
+       return CRYPT_INVALID_ARG;
+    }
+    while (inlen > 0) {
+        if (md->sha256.curlen == 0 && inlen >= 64) {
+           /* whole blocks go to the kernel at once, so it keeps its state in registers */
+           n = inlen / 64;
+           sha256_blocks(md, in, n);
+           md->sha256.length += (ulong64)n * 512;
+           in    += n * 64;
+           inlen -= n * 64;
+        } else {
+           n = MIN(inlen, (64 - md->sha256.curlen));
+           memcpy(md->sha256.buf + md->sha256.curlen, in, (size_t)n);
+           md->sha256.curlen += n;
+           in    += n;
+           inlen -= n;
+           if (md->sha256.curlen == 64) {
+              sha256_blocks(md, md->sha256.buf, 1);
+              md->sha256.length += 512;
+              md->sha256.curlen = 0;
+           }
+       }
+    }
+    return CRYPT_OK;
+}
 
 /**
    Terminate the hash to get the digest
@@ -261,7 +523,7 @@ int ltc_sha256_done(hash_state * md, unsigned char *out)
         while (md->sha256.curlen < 64) {
             md->sha256.buf[md->sha256.curlen++] = (unsigned char)0;
         }
-        sha256_compress(md, md->sha256.buf);
+        sha256_blocks(md, md->sha256.buf, 1);
         md->sha256.curlen = 0;
     }
 
@@ -272,7 +534,7 @@ int ltc_sha256_done(hash_state * md, unsigned char *out)
 
     /* store length */
     STORE64H(md->sha256.length, md->sha256.buf+56);
-    sha256_compress(md, md->sha256.buf);
+    sha256_blocks(md, md->sha256.buf, 1);
 
     /* copy output */
     for (i = 0; i < 8; i++) {
@@ -331,6 +593,8 @@ int  ltc_sha256_test(void)
 #include "ltc_sha224.c"
 #endif
 
+#include "ltc_sha256_multi.c"
+
 #endif
 
 
@@ -0,0 +1,410 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ *
+ * Tom St Denis, tomstdenis@gmail.com, http://libtomcrypt.com
+ */
+/**
+   @param sha256_multi.c
+   Multi-buffer SHA-256 and SHA-224, independent messages are hashed side by side,
+   one message per lane of a vector register.  Included from sha256.c for its K array.
+*/
+
+#ifdef LTC_X86_KERNELS
+
+/* a kernel compresses one block of every lane, state is [8][lanes] and
+   words are the big-endian decoded blocks as [16][lanes] */
+typedef void (*sha256_multi_kernel)(ulong32 *state, const ulong32 *words);
+
+/* the kernel body is written once over vector operations V_*, which each
+   kernel defines for its register width before expanding it */
+#define MB_SIGMA0(x)  V_XOR3(V_ROR(x, 2), V_ROR(x, 13), V_ROR(x, 22))
+#define MB_SIGMA1(x)  V_XOR3(V_ROR(x, 6), V_ROR(x, 11), V_ROR(x, 25))
+#define MB_GAMMA0(x)  V_XOR3(V_ROR(x, 7), V_ROR(x, 18), V_SRL(x, 3))
+#define MB_GAMMA1(x)  V_XOR3(V_ROR(x, 17), V_ROR(x, 19), V_SRL(x, 10))
+
+#define MB_RND(a,b,c,d,e,f,g,h,i)                                                          \
+    if ((i) < 16) {                                                                        \
+        w[(i) & 15] = V_LOAD(words + (i) * LANES);                                         \
+    } else {                                                                               \
+        w[(i) & 15] = V_ADD(V_ADD(MB_GAMMA1(w[((i) - 2) & 15]), w[((i) - 7) & 15]),        \
+                            V_ADD(MB_GAMMA0(w[((i) - 15) & 15]), w[(i) & 15]));           \
+    }                                                                                      \
+    t0 = V_ADD(V_ADD(h, MB_SIGMA1(e)), V_ADD(V_CH(e, f, g), V_ADD(V_SET1(K[i]), w[(i) & 15]))); \
+    t1 = V_ADD(MB_SIGMA0(a), V_MAJ(a, b, c));                                              \
+    d  = V_ADD(d, t0);                                                                     \
+    h  = V_ADD(t0, t1);
+
+#define MB_KERNEL_BODY                                                                     \
+    V a, b, c, d, e, f, g, h, t0, t1, w[16];                                               \
+    int i;                                                                                 \
+    a = V_LOAD(state + 0 * LANES); b = V_LOAD(state + 1 * LANES);                          \
+    c = V_LOAD(state + 2 * LANES); d = V_LOAD(state + 3 * LANES);                          \
+    e = V_LOAD(state + 4 * LANES); f = V_LOAD(state + 5 * LANES);                          \
+    g = V_LOAD(state + 6 * LANES); h = V_LOAD(state + 7 * LANES);                          \
+    for (i = 0; i < 64; i += 8) {                                                          \
+        MB_RND(a,b,c,d,e,f,g,h,i+0);                                                       \
+        MB_RND(h,a,b,c,d,e,f,g,i+1);                                                       \
+        MB_RND(g,h,a,b,c,d,e,f,i+2);                                                       \
+        MB_RND(f,g,h,a,b,c,d,e,i+3);                                                       \
+        MB_RND(e,f,g,h,a,b,c,d,i+4);                                                       \
+        MB_RND(d,e,f,g,h,a,b,c,i+5);                                                       \
+        MB_RND(c,d,e,f,g,h,a,b,i+6);                                                       \
+        MB_RND(b,c,d,e,f,g,h,a,i+7);                                                       \
+    }                                                                                      \
+    V_STORE(state + 0 * LANES, V_ADD(a, V_LOAD(state + 0 * LANES)));                       \
+    V_STORE(state + 1 * LANES, V_ADD(b, V_LOAD(state + 1 * LANES)));                       \
+    V_STORE(state + 2 * LANES, V_ADD(c, V_LOAD(state + 2 * LANES)));                       \
+    V_STORE(state + 3 * LANES, V_ADD(d, V_LOAD(state + 3 * LANES)));                       \
+    V_STORE(state + 4 * LANES, V_ADD(e, V_LOAD(state + 4 * LANES)));                       \
+    V_STORE(state + 5 * LANES, V_ADD(f, V_LOAD(state + 5 * LANES)));                       \
+    V_STORE(state + 6 * LANES, V_ADD(g, V_LOAD(state + 6 * LANES)));                       \
+    V_STORE(state + 7 * LANES, V_ADD(h, V_LOAD(state + 7 * LANES)));
+
+/* four lanes of SSE2 */
+#define LANES         4
+#define V             __m128i
+#define V_LOAD(p)     _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define V_SET1(k)     _mm_set1_epi32((int)(k))
+#define V_ADD(x, y)   _mm_add_epi32(x, y)
+#define V_SRL(x, n)   _mm_srli_epi32(x, n)
+#define V_ROR(x, n)   _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define V_XOR3(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define V_CH(x, y, z)   _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define V_MAJ(x, y, z)  _mm_or_si128(_mm_and_si128(_mm_or_si128(x, y), z), _mm_and_si128(x, y))
+
+LTC_TARGET("sse2")
+static void sha256_multi_sse2(ulong32 *state, const ulong32 *words)
+{
+    MB_KERNEL_BODY
+}
+
+#undef LANES
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_SRL
+#undef V_ROR
+#undef V_XOR3
+#undef V_CH
+#undef V_MAJ
+
+/* eight lanes of AVX2 */
+#define LANES         8
+#define V             __m256i
+#define V_LOAD(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define V_SET1(k)     _mm256_set1_epi32((int)(k))
+#define V_ADD(x, y)   _mm256_add_epi32(x, y)
+#define V_SRL(x, n)   _mm256_srli_epi32(x, n)
+#define V_ROR(x, n)   _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define V_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define V_CH(x, y, z)   _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define V_MAJ(x, y, z)  _mm256_or_si256(_mm256_and_si256(_mm256_or_si256(x, y), z), _mm256_and_si256(x, y))
+
+LTC_TARGET("avx2")
+static void sha256_multi_avx2(ulong32 *state, const ulong32 *words)
+{
+    MB_KERNEL_BODY
+}
+
+#undef LANES
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_SRL
+#undef V_ROR
+#undef V_XOR3
+#undef V_CH
+#undef V_MAJ
+
+/* sixteen lanes of AVX-512, with single instruction rotations and
+   ternary logic for the three-input functions */
+#define LANES         16
+#define V             __m512i
+#define V_LOAD(p)     _mm512_loadu_si512((const void *)(p))
+#define V_STORE(p, x) _mm512_storeu_si512((void *)(p), x)
+#define V_SET1(k)     _mm512_set1_epi32((int)(k))
+#define V_ADD(x, y)   _mm512_add_epi32(x, y)
+#define V_SRL(x, n)   _mm512_srli_epi32(x, n)
+#define V_ROR(x, n)   _mm512_ror_epi32(x, n)
+#define V_XOR3(x, y, z) _mm512_ternarylogic_epi32(x, y, z, 0x96)
+#define V_CH(x, y, z)   _mm512_ternarylogic_epi32(x, y, z, 0xCA)
+#define V_MAJ(x, y, z)  _mm512_ternarylogic_epi32(x, y, z, 0xE8)
+
+LTC_TARGET("avx512f")
+static void sha256_multi_avx512(ulong32 *state, const ulong32 *words)
+{
+    MB_KERNEL_BODY
+}
+
+#undef LANES
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_SRL
+#undef V_ROR
+#undef V_XOR3
+#undef V_CH
+#undef V_MAJ
+
+#undef MB_SIGMA0
+#undef MB_SIGMA1
+#undef MB_GAMMA0
+#undef MB_GAMMA1
+#undef MB_RND
+#undef MB_KERNEL_BODY
+
+#define SHA256_MULTI_LANES 16
+
+static sha256_multi_kernel sha256_multi_blocks = NULL;
+static int sha256_multi_width = -1;
+
+/* a message assigned to a lane, with its padded tail kept aside */
+typedef struct {
+    long msg;
+    unsigned long block, full, blocks;
+    unsigned char tail[128];
+} sha256_lane;
+
+/* start message msg in lane l, or leave the lane idle if msg is -1 */
+static void sha256_multi_assign(sha256_lane *lane, ulong32 *state, int lanes, int l,
+                                long msg, const unsigned char *in, unsigned long inlen,
+                                const ulong32 *iv)
+{
+    unsigned long rest;
+    int i;
+
+    lane->msg = msg;
+    if (msg < 0) {
+       return;
+    }
+    for (i = 0; i < 8; i++) {
+        state[i * lanes + l] = iv[i];
+    }
+    /* whole blocks are read from the message, the rest and the padding from the tail */
+    lane->block  = 0;
+    lane->full   = inlen / 64;
+    rest         = inlen % 64;
+    lane->blocks = lane->full + (rest < 56 ? 1 : 2);
+    zeromem(lane->tail, sizeof(lane->tail));
+    XMEMCPY(lane->tail, in + lane->full * 64, rest);
+    lane->tail[rest] = 0x80;
+    STORE64H((ulong64)inlen * 8, lane->tail + (lane->blocks - lane->full) * 64 - 8);
+}
+
+/* hash count messages side by side, lanes of messages already finished take on
+   the following ones; the last few messages are finished one by one rather than
+   in a mostly idle register */
+static int sha256_multi(const unsigned char * const *in, const unsigned long *inlen,
+                        unsigned char **out, unsigned long count, int sha224)
+{
+    ulong32 state[8 * SHA256_MULTI_LANES], words[16 * SHA256_MULTI_LANES], iv[8];
+    sha256_lane lane[SHA256_MULTI_LANES];
+    hash_state md;
+    unsigned long next = 0;
+    const unsigned char *p;
+    int lanes = sha256_multi_width, active = 0, i, j, l;
+
+    if (sha224) ltc_sha224_init(&md); else ltc_sha256_init(&md);
+    for (i = 0; i < 8; i++) {
+        iv[i] = md.sha256.state[i];
+    }
+    zeromem(words, sizeof(words));
+    for (l = 0; l < lanes; l++) {
+        if (next < count) {
+           sha256_multi_assign(&lane[l], state, lanes, l, (long)next, in[next], inlen[next], iv);
+           next++;
+           active++;
+        } else {
+           lane[l].msg = -1;
+        }
+    }
+
+    while (active > 0) {
+        if ((next >= count) && (active * 2 <= lanes)) {
+           break;
+        }
+        for (l = 0; l < lanes; l++) {
+            if (lane[l].msg < 0) continue;
+            p = (lane[l].block < lane[l].full) ? in[lane[l].msg] + lane[l].block * 64
+                                               : lane[l].tail + (lane[l].block - lane[l].full) * 64;
+            for (j = 0; j < 16; j++) {
+                LOAD32H(words[j * lanes + l], p + 4 * j);
+            }
+        }
+        sha256_multi_blocks(state, words);
+        for (l = 0; l < lanes; l++) {
+            if (lane[l].msg < 0) continue;
+            if (++lane[l].block < lane[l].blocks) continue;
+            for (j = 0; j < (sha224 ? 7 : 8); j++) {
+                STORE32H(state[j * lanes + l], out[lane[l].msg] + 4 * j);
+            }
+            if (next < count) {
+               sha256_multi_assign(&lane[l], state, lanes, l, (long)next, in[next], inlen[next], iv);
+               next++;
+            } else {
+               lane[l].msg = -1;
+               active--;
+            }
+        }
+    }
+
+    /* stragglers continue from their state in a regular context */
+    for (l = 0; l < lanes; l++) {
+        if (lane[l].msg < 0) continue;
+        for (i = 0; i < 8; i++) {
+            md.sha256.state[i] = state[i * lanes + l];
+        }
+        md.sha256.curlen = 0;
+        if (lane[l].block <= lane[l].full) {
+           md.sha256.length = (ulong64)lane[l].block * 512;
+           ltc_sha256_process(&md, in[lane[l].msg] + lane[l].block * 64,
+                              inlen[lane[l].msg] - lane[l].block * 64);
+           if (sha224) ltc_sha224_done(&md, out[lane[l].msg]); else ltc_sha256_done(&md, out[lane[l].msg]);
+        } else {
+           /* only the second block of the padding is left */
+           sha256_blocks(&md, lane[l].tail + 64, 1);
+           for (j = 0; j < (sha224 ? 7 : 8); j++) {
+               STORE32H(md.sha256.state[j], out[lane[l].msg] + 4 * j);
+           }
+        }
+    }
+#ifdef LTC_CLEAN_STACK
+    zeromem(state, sizeof(state));
+    zeromem(words, sizeof(words));
+    zeromem(lane, sizeof(lane));
+    zeromem(&md, sizeof(md));
+#endif
+    return CRYPT_OK;
+}
+#endif /* LTC_X86_KERNELS */
+
+/**
+   Select the multi-buffer kernel of SHA-256 and SHA-224.  A single stream with
+   SHA extensions outruns fewer than sixteen lanes, so they are not used then.
+   @param features  Extensions allowed, usually ltc_cpu_features(), 0 for none
+   @return Number of messages hashed side by side, 0 if messages are hashed one by one
+*/
+int ltc_sha256_multi_select(int features)
+{
+#ifdef LTC_X86_KERNELS
+    if (features & LTC_CPU_AVX512) {
+       sha256_multi_blocks = sha256_multi_avx512;
+       sha256_multi_width  = 16;
+    } else if (features & LTC_CPU_SHA) {
+       sha256_multi_blocks = NULL;
+       sha256_multi_width  = 0;
+    } else if (features & LTC_CPU_AVX2) {
+       sha256_multi_blocks = sha256_multi_avx2;
+       sha256_multi_width  = 8;
+    } else if (features & LTC_CPU_SSE2) {
+       sha256_multi_blocks = sha256_multi_sse2;
+       sha256_multi_width  = 4;
+    } else {
+       sha256_multi_blocks = NULL;
+       sha256_multi_width  = 0;
+    }
+    return sha256_multi_width;
+#else
+    (void)features;
+    return 0;
+#endif
+}
+
+/**
+   Number of messages hashed side by side, the kernel is selected on the first
+   call unless selected before
+   @return Number of lanes, 0 if messages are hashed one by one
+*/
+int ltc_sha256_multi_lanes(void)
+{
+#ifdef LTC_X86_KERNELS
+    if (sha256_multi_width < 0) {
+       ltc_sha256_multi_select(ltc_cpu_features());
+    }
+    return sha256_multi_width;
+#else
+    return 0;
+#endif
+}
+
+/**
+   Hash several independent messages at once, each digest is that of
+   init, process and done on the message alone
+   @param in      The messages
+   @param inlen   Lengths of the messages (octets)
+   @param out     [out] Destinations of the digests (32 bytes each)
+   @param count   The number of messages
+   @return CRYPT_OK if successful
+*/
+int ltc_sha256_multi(const unsigned char * const *in, const unsigned long *inlen,
+                     unsigned char **out, unsigned long count)
+{
+    hash_state md;
+    unsigned long i;
+
+    LTC_ARGCHK(in != NULL);
+    LTC_ARGCHK(inlen != NULL);
+    LTC_ARGCHK(out != NULL);
+#ifdef LTC_X86_KERNELS
+    if (sha256_multi_width < 0) {
+       ltc_sha256_multi_select(ltc_cpu_features());
+    }
+    if ((sha256_multi_width > 0) && (count > 1)) {
+       return sha256_multi(in, inlen, out, count, 0);
+    }
+#endif
+    for (i = 0; i < count; i++) {
+        ltc_sha256_init(&md);
+        ltc_sha256_process(&md, in[i], inlen[i]);
+        ltc_sha256_done(&md, out[i]);
+    }
+    return CRYPT_OK;
+}
+
+#ifdef SHA224
+/**
+   Hash several independent messages at once with SHA-224
+   @param in      The messages
+   @param inlen   Lengths of the messages (octets)
+   @param out     [out] Destinations of the digests (28 bytes each)
+   @param count   The number of messages
+   @return CRYPT_OK if successful
+*/
+int ltc_sha224_multi(const unsigned char * const *in, const unsigned long *inlen,
+                     unsigned char **out, unsigned long count)
+{
+    hash_state md;
+    unsigned long i;
+
+    LTC_ARGCHK(in != NULL);
+    LTC_ARGCHK(inlen != NULL);
+    LTC_ARGCHK(out != NULL);
+#ifdef LTC_X86_KERNELS
+    if (sha256_multi_width < 0) {
+       ltc_sha256_multi_select(ltc_cpu_features());
+    }
+    if ((sha256_multi_width > 0) && (count > 1)) {
+       return sha256_multi(in, inlen, out, count, 1);
+    }
+#endif
+    for (i = 0; i < count; i++) {
+        ltc_sha224_init(&md);
+        ltc_sha256_process(&md, in[i], inlen[i]);
+        ltc_sha224_done(&md, out[i]);
+    }
+    return CRYPT_OK;
+}
+#endif
@@ -167,6 +167,156 @@ static int sha512_compress(hash_state * md, unsigned char *buf)
 }
 #endif
 
+/* compress consecutive blocks, the portable code is the reference for the kernels below */
+static void sha512_blocks_c(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    for (; blocks > 0; blocks--, buf += 128) {
+        sha512_compress(md, (unsigned char *)buf);
+    }
+}
+
+#ifdef LTC_X86_KERNELS
+#include <immintrin.h>
+
+/* rounds are scalar, x is W[i] + K[i] taken from the vector schedule */
+#define RNDX(a,b,c,d,e,f,g,h,x)                     \
+     t0 = h + Sigma1(e) + Ch(e, f, g) + (x);        \
+     t1 = Sigma0(a) + Maj(a, b, c);                 \
+     d += t0;                                       \
+     h  = t0 + t1;
+
+/* a register holds four schedule words, ROR and XOR3 are the instructions
+   of the kernel for rotating and for combining three terms */
+#define GAMMA0_256(x, ROR, XOR3)  XOR3(ROR(x, 1), ROR(x, 8), _mm256_srli_epi64(x, 7))
+#define GAMMA1_256(x, ROR, XOR3)  XOR3(ROR(x, 19), ROR(x, 61), _mm256_srli_epi64(x, 6))
+
+/* W[t+1..t+4] from a = W[t..t+3] and b = W[t+4..t+7] */
+#define NEXT_256(a, b)  _mm256_alignr_epi8(_mm256_permute2x128_si256(a, b, 0x21), a, 8)
+
+/* group n of W[4n..4n+3] + K is computed in place of group n-4; Gamma1 needs
+   the first two words of the same group, so the upper half is finished after
+   the lower one.  Permutations with bit 7 or 3 set clear the half they would
+   otherwise fill, and Gamma1 of zero is zero. */
+#define SCHEDULE_256(n, ROR, XOR3)                                                            \
+    x = &w[(n) & 3];                                                                          \
+    *x = _mm256_add_epi64(*x, GAMMA0_256(NEXT_256(*x, w[((n)+1) & 3]), ROR, XOR3));           \
+    *x = _mm256_add_epi64(*x, NEXT_256(w[((n)+2) & 3], w[((n)+3) & 3]));                      \
+    *x = _mm256_add_epi64(*x, GAMMA1_256(_mm256_permute2x128_si256(w[((n)+3) & 3], w[((n)+3) & 3], 0x81), ROR, XOR3)); \
+    *x = _mm256_add_epi64(*x, GAMMA1_256(_mm256_permute2x128_si256(*x, *x, 0x08), ROR, XOR3)); \
+    _mm256_storeu_si256((__m256i *)(wk + 4*(n)),                                              \
+        _mm256_add_epi64(*x, _mm256_loadu_si256((const __m256i *)(K + 4*(n)))));
+
+#define SHA512_BLOCKS(ROR, XOR3)                                                              \
+    const __m256i swap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, \
+                                         8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);\
+    ulong64 wk[80], a, b, c, d, e, f, g, h, t0, t1;                                           \
+    __m256i w[4], *x;                                                                         \
+    int i;                                                                                    \
+                                                                                              \
+    for (; blocks > 0; blocks--, buf += 128) {                                                \
+        for (i = 0; i < 4; i++) {                                                             \
+            w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(buf + 32*i)), swap); \
+            _mm256_storeu_si256((__m256i *)(wk + 4*i),                                        \
+                _mm256_add_epi64(w[i], _mm256_loadu_si256((const __m256i *)(K + 4*i))));      \
+        }                                                                                     \
+        a = md->sha512.state[0]; b = md->sha512.state[1];                                     \
+        c = md->sha512.state[2]; d = md->sha512.state[3];                                     \
+        e = md->sha512.state[4]; f = md->sha512.state[5];                                     \
+        g = md->sha512.state[6]; h = md->sha512.state[7];                                     \
+        /* the schedule runs four words ahead of the rounds, so both overlap */               \
+        for (i = 0; i < 80; i += 8) {                                                         \
+            if (i < 64) {                                                                     \
+                SCHEDULE_256(i/4 + 4, ROR, XOR3)                                              \
+            }                                                                                 \
+            RNDX(a,b,c,d,e,f,g,h,wk[i+0]);                                                    \
+            RNDX(h,a,b,c,d,e,f,g,wk[i+1]);                                                    \
+            RNDX(g,h,a,b,c,d,e,f,wk[i+2]);                                                    \
+            RNDX(f,g,h,a,b,c,d,e,wk[i+3]);                                                    \
+            if (i < 64) {                                                                     \
+                SCHEDULE_256(i/4 + 5, ROR, XOR3)                                              \
+            }                                                                                 \
+            RNDX(e,f,g,h,a,b,c,d,wk[i+4]);                                                    \
+            RNDX(d,e,f,g,h,a,b,c,wk[i+5]);                                                    \
+            RNDX(c,d,e,f,g,h,a,b,wk[i+6]);                                                    \
+            RNDX(b,c,d,e,f,g,h,a,wk[i+7]);                                                    \
+        }                                                                                     \
+        md->sha512.state[0] += a; md->sha512.state[1] += b;                                   \
+        md->sha512.state[2] += c; md->sha512.state[3] += d;                                   \
+        md->sha512.state[4] += e; md->sha512.state[5] += f;                                   \
+        md->sha512.state[6] += g; md->sha512.state[7] += h;                                   \
+    }
+
+#define ROR_AVX2(x, n)        _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define XOR3_AVX2(x, y, z)    _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define ROR_AVX512(x, n)      _mm256_ror_epi64(x, n)
+#define XOR3_AVX512(x, y, z)  _mm256_ternarylogic_epi64(x, y, z, 0x96)
+
+LTC_TARGET("avx2")
+static void sha512_blocks_avx2(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    SHA512_BLOCKS(ROR_AVX2, XOR3_AVX2)
+#ifdef LTC_CLEAN_STACK
+    zeromem(wk, sizeof(wk));
+#endif
+}
+
+/* rotations and three-way XOR are single instructions, registers stay 256 bits
+   wide so the schedule is the same as that of AVX2 */
+LTC_TARGET("avx2,avx512f,avx512vl")
+static void sha512_blocks_avx512(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    SHA512_BLOCKS(ROR_AVX512, XOR3_AVX512)
+#ifdef LTC_CLEAN_STACK
+    zeromem(wk, sizeof(wk));
+#endif
+}
+
+#undef RNDX
+#undef GAMMA0_256
+#undef GAMMA1_256
+#undef NEXT_256
+#undef SCHEDULE_256
+#undef SHA512_BLOCKS
+#undef ROR_AVX2
+#undef XOR3_AVX2
+#undef ROR_AVX512
+#undef XOR3_AVX512
+#endif /* LTC_X86_KERNELS */
+
+static void sha512_blocks_first(hash_state * md, const unsigned char *buf, unsigned long blocks);
+
+/* the kernel in use, chosen by the first call unless selected before */
+static void (*sha512_blocks)(hash_state * md, const unsigned char *buf, unsigned long blocks) = sha512_blocks_first;
+
+static void sha512_blocks_first(hash_state * md, const unsigned char *buf, unsigned long blocks)
+{
+    ltc_sha512_select(ltc_cpu_features());
+    sha512_blocks(md, buf, blocks);
+}
+
+/**
+   Select the compression kernel of SHA-512 and SHA-384, the portable code is used
+   where the CPU lacks AVX2.  Threads racing through this store the same kernel.
+   @param features  Extensions allowed, usually ltc_cpu_features(), 0 for the portable code
+   @return The LTC_CPU_* flag of the selected kernel, 0 for the portable code
+*/
+int ltc_sha512_select(int features)
+{
+#ifdef LTC_X86_KERNELS
+    if ((features & LTC_CPU_AVX512) && (features & LTC_CPU_AVX2)) {
+       sha512_blocks = sha512_blocks_avx512;
+       return LTC_CPU_AVX512;
+    }
+    if (features & LTC_CPU_AVX2) {
+       sha512_blocks = sha512_blocks_avx2;
+       return LTC_CPU_AVX2;
+    }
+#endif
+    (void)features;
+    sha512_blocks = sha512_blocks_c;
+    return 0;
+}
+
 /**
    Initialize the hash state
    @param md   The hash state you wish to initialize
@@ -195,7 +345,37 @@ int ltc_sha512_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(ltc_sha512_process, sha512_compress, sha512, 128)
+int ltc_sha512_process(hash_state * md, const unsigned char *in, unsigned long inlen)
+{
+    unsigned long n;
+    LTC_ARGCHK(md != NULL);
+    LTC_ARGCHK(in != NULL);
+    if (md->sha512.curlen > sizeof(md->sha512.buf)) {
+       return CRYPT_INVALID_ARG;
+    }
+    while (inlen > 0) {
+        if (md->sha512.curlen == 0 && inlen >= 128) {
+           /* whole blocks go to the kernel at once */
+           n = inlen / 128;
+           sha512_blocks(md, in, n);
+           md->sha512.length += (ulong64)n * 1024;
+           in    += n * 128;
+           inlen -= n * 128;
+        } else {
+           n = MIN(inlen, (128 - md->sha512.curlen));
+           memcpy(md->sha512.buf + md->sha512.curlen, in, (size_t)n);
+           md->sha512.curlen += n;
+           in    += n;
+           inlen -= n;
+           if (md->sha512.curlen == 128) {
+              sha512_blocks(md, md->sha512.buf, 1);
+              md->sha512.length += 1024;
+              md->sha512.curlen = 0;
+           }
+       }
+    }
+    return CRYPT_OK;
+}
 
 /**
    Terminate the hash to get the digest
@@ -228,7 +408,7 @@ int ltc_sha512_done(hash_state * md, unsigned char *out)
         while (md->sha512.curlen < 128) {
             md->sha512.buf[md->sha512.curlen++] = (unsigned char)0;
         }
-        sha512_compress(md, md->sha512.buf);
+        sha512_blocks(md, md->sha512.buf, 1);
         md->sha512.curlen = 0;
     }
 
@@ -242,7 +422,7 @@ int ltc_sha512_done(hash_state * md, unsigned char *out)
 
     /* store length */
     STORE64H(md->sha512.length, md->sha512.buf+120);
-    sha512_compress(md, md->sha512.buf);
+    sha512_blocks(md, md->sha512.buf, 1);
 
     /* copy output */
     for (i = 0; i < 8; i++) {
@@ -130,6 +130,18 @@ LTC_EXPORT int   LTC_CALL XSTRCMP(const char *s1, const char *s2);
    #define ENDIAN_NEUTRAL
 #endif
 
+/* x86 hash kernels are written with intrinsics and compiled for single functions,
+ * so the rest of the library needs no extra flags; they are picked at run time
+ * by ltc_cpu_features().  Define LTC_NO_X86_KERNELS to leave them out. */
+#if !defined(LTC_NO_X86_KERNELS) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+   #define LTC_X86_KERNELS
+   #define LTC_TARGET(x) __attribute__((target(x)))
+#elif !defined(LTC_NO_X86_KERNELS) && defined(_MSC_VER) && (_MSC_VER >= 1900) && (defined(_M_X64) || defined(_M_IX86))
+   #define LTC_X86_KERNELS
+   #define LTC_TARGET(x)
+#endif
+
 #endif
 
 
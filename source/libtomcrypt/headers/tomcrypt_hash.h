@@ -213,6 +213,7 @@ int ltc_sha512_init(hash_state * md);
 int ltc_sha512_process(hash_state * md, const unsigned char *in, unsigned long inlen);
 int ltc_sha512_done(hash_state * md, unsigned char *hash);
 int ltc_sha512_test(void);
+int ltc_sha512_select(int features);
 extern const struct ltc_hash_descriptor sha512_desc;
 #endif
 
@@ -232,6 +233,11 @@ int ltc_sha256_init(hash_state * md);
 int ltc_sha256_process(hash_state * md, const unsigned char *in, unsigned long inlen);
 int ltc_sha256_done(hash_state * md, unsigned char *hash);
 int ltc_sha256_test(void);
+int ltc_sha256_select(int features);
+int ltc_sha256_multi_select(int features);
+int ltc_sha256_multi_lanes(void);
+int ltc_sha256_multi(const unsigned char * const *in, const unsigned long *inlen,
+                     unsigned char **out, unsigned long count);
 extern const struct ltc_hash_descriptor sha256_desc;
 
 #ifdef SHA224
@@ -242,6 +248,8 @@ int ltc_sha224_init(hash_state * md);
 #define ltc_sha224_process ltc_sha256_process
 int ltc_sha224_done(hash_state * md, unsigned char *hash);
 int ltc_sha224_test(void);
+int ltc_sha224_multi(const unsigned char * const *in, const unsigned long *inlen,
+                     unsigned char **out, unsigned long count);
 extern const struct ltc_hash_descriptor sha224_desc;
 #endif
 #endif
@@ -15,6 +15,16 @@ const char *error_to_string(int err);
 
 extern const char *crypt_build_settings;
 
+/* ---- CPU features ---- */
+#define LTC_CPU_SSSE3    0x0001
+#define LTC_CPU_SSE41    0x0002
+#define LTC_CPU_AVX2     0x0004
+#define LTC_CPU_SHA      0x0008
+#define LTC_CPU_AVX512   0x0010
+#define LTC_CPU_SSE2     0x0020
+
+int ltc_cpu_features(void);
+
 /* ---- HMM ---- */
 int crypt_fsa(void *mp, ...);
 
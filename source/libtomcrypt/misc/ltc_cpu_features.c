@@ -0,0 +1,98 @@
+/* LibTomCrypt, modular cryptographic library -- Tom St Denis
+ *
+ * LibTomCrypt is a library that provides various cryptographic
+ * algorithms in a highly modular and flexible manner.
+ *
+ * The library is free for all purposes without any express
+ * guarantee it works.
+ *
+ * Tom St Denis, tomstdenis@gmail.com, http://libtomcrypt.com
+ */
+#include "tomcrypt.h"
+
+/**
+   @file cpu_features.c
+   Detect instruction set extensions used by hash kernels
+*/
+
+#if defined(LTC_X86_KERNELS) && defined(__GNUC__)
+#include <cpuid.h>
+#elif defined(LTC_X86_KERNELS)
+#include <intrin.h>
+#endif
+
+#ifdef LTC_X86_KERNELS
+static void cpuid(unsigned leaf, unsigned *regs)
+{
+#ifdef __GNUC__
+    if (__get_cpuid_max(0, NULL) < leaf) {
+       regs[0] = regs[1] = regs[2] = regs[3] = 0;
+       return;
+    }
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if ((unsigned)info[0] < leaf) {
+       regs[0] = regs[1] = regs[2] = regs[3] = 0;
+       return;
+    }
+    __cpuidex(info, (int)leaf, 0);
+    regs[0] = info[0]; regs[1] = info[1]; regs[2] = info[2]; regs[3] = info[3];
+#endif
+}
+
+/* register state the operating system saves on context switches */
+static ulong64 xgetbv(void)
+{
+#ifdef __GNUC__
+    unsigned lo, hi;
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((ulong64)hi << 32) | lo;
+#else
+    return _xgetbv(0);
+#endif
+}
+
+static int cpu_detect(void)
+{
+    unsigned regs[4];
+    int features = 0;
+
+    cpuid(1, regs);
+    if (regs[3] & (1UL << 26)) features |= LTC_CPU_SSE2;
+    if (regs[2] & (1UL << 9))  features |= LTC_CPU_SSSE3;
+    if (regs[2] & (1UL << 19)) features |= LTC_CPU_SSE41;
+    /* AVX registers are usable only if the OS saves them, OSXSAVE and XCR0 tell */
+    if ((regs[2] & (1UL << 27)) && (regs[2] & (1UL << 28)) && (xgetbv() & 6) == 6) {
+       ulong64 xcr0 = xgetbv();
+       cpuid(7, regs);
+       if (regs[1] & (1UL << 5)) features |= LTC_CPU_AVX2;
+       /* AVX-512 foundation and vector length extensions, with opmask and upper registers saved */
+       if ((regs[1] & (1UL << 16)) && (regs[1] & (1UL << 31)) && (xcr0 & 0xE6) == 0xE6) {
+          features |= LTC_CPU_AVX512;
+       }
+    }
+    cpuid(7, regs);
+    if (regs[1] & (1UL << 29)) features |= LTC_CPU_SHA;
+    return features;
+}
+#endif
+
+/**
+   Instruction set extensions of this CPU usable by hash kernels
+   @return A combination of LTC_CPU_* flags, 0 if there are no kernels for this platform
+*/
+int ltc_cpu_features(void)
+{
+#ifdef LTC_X86_KERNELS
+    /* threads racing through the first call store the same value */
+    static volatile int features = -1;
+    if (features < 0) {
+       features = cpu_detect();
+    }
+    return features;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,227 @@
+/* test_sha2.c - checks vector kernels of SHA-2 against the portable code */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tomcrypt.h"
+
+/************************************************************************
+ *                         Data for tests
+ ************************************************************************/
+static unsigned char message[65536 + 4096];
+
+static int n_errors = 0;
+
+static void fill_message(void) {
+  unsigned i;
+  srand(1);
+  for(i=0; i<sizeof(message); i++) message[i] = (unsigned char)rand();
+}
+
+static void to_hex(const unsigned char* digest, unsigned long size, char* text) {
+  unsigned long i;
+  for(i=0; i<size; i++) sprintf(text + 2 * i, "%02X", digest[i]);
+}
+
+static int assert_equals(const unsigned char* obtained, const unsigned char* expected,
+  unsigned long size, const char* name, const char* msg) {
+  int success = (memcmp(obtained, expected, size) == 0);
+  if(!success) {
+    char hash_obtained[129], hash_expected[129];
+    to_hex(obtained, size, hash_obtained);
+    to_hex(expected, size, hash_expected);
+    printf("error: %-7s (%s) = %s, expected: %s\n", name, msg, hash_obtained, hash_expected);
+    n_errors++;
+  }
+  return success;
+}
+
+/* lengths of pieces a message is fed in, 0 feeds it at once */
+static const unsigned long pieces[] = { 0, 1, 63, 65, 200 };
+
+/************************************************************************
+ *                            Test functions
+ ************************************************************************/
+
+static void sha256_by_pieces(const unsigned char* msg, unsigned long size, unsigned long piece,
+  int sha224, unsigned char* digest) {
+  hash_state md;
+  unsigned long n;
+  if(sha224) ltc_sha224_init(&md); else ltc_sha256_init(&md);
+  for(; size > 0; msg += n, size -= n) {
+    n = (piece == 0 || piece > size) ? size : piece;
+    ltc_sha256_process(&md, msg, n);
+  }
+  if(sha224) ltc_sha224_done(&md, digest); else ltc_sha256_done(&md, digest);
+}
+
+/* run every SHA-256 kernel the CPU supports over all short lengths and random
+ * longer ones, from unaligned offsets and in pieces, against the portable code */
+static void test_sha256_kernels(void) {
+  static const int kernels[] = { LTC_CPU_SSSE3, LTC_CPU_AVX2, LTC_CPU_SHA };
+  static const int needs[] = { LTC_CPU_SSSE3, LTC_CPU_AVX2 | LTC_CPU_SSSE3, LTC_CPU_SHA | LTC_CPU_SSE41 };
+  static const char* names[] = { "SSSE3", "AVX2", "SHA" };
+  const int features = ltc_cpu_features();
+  unsigned char expected[32], obtained[32];
+  unsigned long size, offset, piece;
+  int k, i, sha224;
+
+  for(k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++) {
+    char name[80];
+    if((features & needs[k]) != needs[k]) {
+      printf("SHA-256 %s kernel skipped, not supported by this CPU\n", names[k]);
+      continue;
+    }
+    for(i=0; i<600; i++) {
+      size = (i < 300) ? (unsigned long)i : (unsigned long)(rand() % 4096);
+      offset = (unsigned long)(rand() % 16);
+      piece = pieces[i % (sizeof(pieces)/sizeof(pieces[0]))];
+      sha224 = i & 1;
+      ltc_sha256_select(0);
+      sha256_by_pieces(message + offset, size, piece, sha224, expected);
+      if(ltc_sha256_select(needs[k]) != kernels[k]) {
+        printf("error: %s kernel of SHA-256 not selected\n", names[k]);
+        n_errors++;
+        break;
+      }
+      sha256_by_pieces(message + offset, size, piece, sha224, obtained);
+      sprintf(name, "%s, %lu bytes at offset %lu by %lu", names[k], size, offset, piece);
+      assert_equals(obtained, expected, sha224 ? 28 : 32, sha224 ? "SHA-224" : "SHA-256", name);
+    }
+  }
+  ltc_sha256_select(features);
+}
+
+static void sha512_by_pieces(const unsigned char* msg, unsigned long size, unsigned long piece,
+  int sha384, unsigned char* digest) {
+  hash_state md;
+  unsigned long n;
+  if(sha384) ltc_sha384_init(&md); else ltc_sha512_init(&md);
+  for(; size > 0; msg += n, size -= n) {
+    n = (piece == 0 || piece > size) ? size : piece;
+    ltc_sha512_process(&md, msg, n);
+  }
+  if(sha384) ltc_sha384_done(&md, digest); else ltc_sha512_done(&md, digest);
+}
+
+static void check_sha512(int kernel, int flags, const char* kernel_name,
+  unsigned long size, unsigned long offset, unsigned long piece, int sha384) {
+  unsigned char expected[64], obtained[64];
+  char name[80];
+  ltc_sha512_select(0);
+  sha512_by_pieces(message + offset, size, piece, sha384, expected);
+  if(ltc_sha512_select(flags) != kernel) {
+    printf("error: %s kernel of SHA-512 not selected\n", kernel_name);
+    n_errors++;
+    return;
+  }
+  sha512_by_pieces(message + offset, size, piece, sha384, obtained);
+  sprintf(name, "%s, %lu bytes at offset %lu by %lu", kernel_name, size, offset, piece);
+  assert_equals(obtained, expected, sha384 ? 48 : 64, sha384 ? "SHA-384" : "SHA-512", name);
+}
+
+/* the same for SHA-512 and SHA-384, lengths where the padding spills into
+ * one more 128-byte block are tried at every offset and by every piece */
+static void test_sha512_kernels(void) {
+  static const int kernels[] = { LTC_CPU_AVX2, LTC_CPU_AVX512 };
+  static const int needs[] = { LTC_CPU_AVX2, LTC_CPU_AVX512 | LTC_CPU_AVX2 };
+  static const char* names[] = { "AVX2", "AVX-512" };
+  static const unsigned long boundaries[] = { 111, 112, 113, 127, 128, 129, 239, 240, 241, 255, 256, 257 };
+  const int features = ltc_cpu_features();
+  unsigned long size, offset, piece;
+  int k, i, j;
+
+  for(k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++) {
+    if((features & needs[k]) != needs[k]) {
+      printf("SHA-512 %s kernel skipped, not supported by this CPU\n", names[k]);
+      continue;
+    }
+    for(i=0; i<(int)(sizeof(boundaries)/sizeof(boundaries[0])); i++) {
+      for(offset=0; offset<16; offset++) {
+        for(j=0; j<(int)(sizeof(pieces)/sizeof(pieces[0])); j++) {
+          check_sha512(kernels[k], needs[k], names[k], boundaries[i], offset, pieces[j], (int)(offset & 1));
+        }
+      }
+    }
+    for(i=0; i<600; i++) {
+      size = (i < 300) ? (unsigned long)i : (unsigned long)(rand() % 4096);
+      offset = (unsigned long)(rand() % 16);
+      piece = pieces[i % (sizeof(pieces)/sizeof(pieces[0]))];
+      check_sha512(kernels[k], needs[k], names[k], size, offset, piece, i & 1);
+    }
+  }
+  ltc_sha512_select(features);
+}
+
+/* hash groups of messages in lanes, groups larger than the lanes refill them
+ * as short messages finish while long stragglers keep going, every digest
+ * must equal that of the message hashed alone by the portable code */
+static void test_sha256_multi(void) {
+  static const int kernels[] = { LTC_CPU_SSE2, LTC_CPU_AVX2, LTC_CPU_AVX512 };
+  static const int widths[] = { 4, 8, 16 };
+  static const char* names[] = { "SSE2", "AVX2", "AVX-512" };
+  static const unsigned long groups[] = { 2, 3, 5, 9, 15, 16, 17, 40, 70 };
+  static const unsigned long edges[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128 };
+  const unsigned char* msgs[70];
+  unsigned long sizes[70];
+  unsigned char digests[70][32];
+  unsigned char* results[70];
+  unsigned char expected[32];
+  const int features = ltc_cpu_features();
+  hash_state md;
+  unsigned long g, i;
+  int k, round, sha224;
+
+  for(i=0; i<70; i++) results[i] = digests[i];
+  for(k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++) {
+    if(!(features & kernels[k])) {
+      printf("SHA-256 %s lanes skipped, not supported by this CPU\n", names[k]);
+      continue;
+    }
+    for(round=0; round<8; round++) {
+      for(g=0; g<sizeof(groups)/sizeof(groups[0]); g++) {
+        for(i=0; i<groups[g]; i++) {
+          /* some messages in a group are much longer than the rest */
+          if((i + round) % 7 == 0) sizes[i] = 2048 + (unsigned long)(rand() % 2048);
+          else if((i + round) % 2 == 0) sizes[i] = edges[(i + round) % (sizeof(edges)/sizeof(edges[0]))];
+          else sizes[i] = (unsigned long)(rand() % 512);
+          msgs[i] = message + rand() % 65536;
+        }
+        sha224 = round & 1;
+        if(ltc_sha256_multi_select(kernels[k]) != widths[k]) {
+          printf("error: %s lanes of SHA-256 not selected\n", names[k]);
+          n_errors++;
+          round = 8;
+          break;
+        }
+        if(sha224) ltc_sha224_multi(msgs, sizes, results, groups[g]);
+        else ltc_sha256_multi(msgs, sizes, results, groups[g]);
+
+        ltc_sha256_select(0);
+        for(i=0; i<groups[g]; i++) {
+          char name[80];
+          if(sha224) ltc_sha224_init(&md); else ltc_sha256_init(&md);
+          ltc_sha256_process(&md, msgs[i], sizes[i]);
+          if(sha224) ltc_sha224_done(&md, expected); else ltc_sha256_done(&md, expected);
+          sprintf(name, "%s lanes, message %lu of %lu, %lu bytes", names[k], i, groups[g], sizes[i]);
+          assert_equals(results[i], expected, sha224 ? 28 : 32, sha224 ? "SHA-224" : "SHA-256", name);
+        }
+      }
+    }
+  }
+  ltc_sha256_multi_select(features);
+  ltc_sha256_select(features);
+}
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  fill_message();
+  test_sha256_kernels();
+  test_sha512_kernels();
+  test_sha256_multi();
+  if(n_errors==0) printf("All kernels are working properly!\n");
+  fflush(stdout);
+
+  return (n_errors==0 ? 0 : 1);
+}
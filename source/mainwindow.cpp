@@ -264,6 +264,35 @@ void MainWindow::saveSettings(void)
  m_Settings->setValue("core.rootpath",m_FileHasher->rootPath());
  m_Settings->setValue("core.encoding",m_FileHasher->textEncoding());
  m_Settings->setValue("core.algorithm",m_FileHasher->hashAlgorithm());
+ m_Settings->setValue("core.hashing.workers",m_FileHasher->workerCount());
+ m_Settings->setValue("core.hashing.readmode",m_FileHasher->readMode());
+ m_Settings->setValue("core.hashing.hugepages",m_FileHasher->doUseHugePages());
+ m_Settings->setValue("core.hashing.iouring",m_FileHasher->doUseIoUring());
+ m_Settings->setValue("core.hashing.perdevice",m_FileHasher->doScheduleByDevice());
+ m_Settings->setValue("core.hashing.largestfirst",m_FileHasher->doScheduleLargestFirst());
+ m_Settings->setValue("core.hashing.autotune",m_FileHasher->doAutoTune());
+ m_Settings->setValue("core.hashing.progressrate",m_FileHasher->progressRate());
+ m_Settings->setValue("core.hashing.batchthreads",m_FileHasher->doHashBatchInParallel());
+ m_Settings->setValue("core.hashing.splitfiles",m_FileHasher->doSplitLargeFiles());
+ m_Settings->setValue("core.hashing.lanes",m_FileHasher->doHashFilesInLanes());
+ m_Settings->setValue("core.hashing.checkpoints",m_FileHasher->doUseCheckpoints());
+ m_Settings->setValue("core.hashing.checkpointdir",m_FileHasher->checkpointDirectory());
+ m_Settings->setValue("core.hashing.placement",m_FileHasher->placementMode());
+ m_Settings->setValue("core.hashing.cpus",m_FileHasher->workerCpus());
+ m_Settings->setValue("core.hashing.reservedcpus",m_FileHasher->reservedCpus());
+ m_Settings->setValue("core.hashing.priority",m_FileHasher->threadPriority());
+ m_Settings->setValue("core.hashing.ratelimit",m_FileHasher->byteRateLimit());
+ m_Settings->setValue("core.hashing.dutycycle",m_FileHasher->dutyCycle());
+ m_Settings->setValue("core.hashing.ioclass",m_FileHasher->ioClass());
+ m_Settings->setValue("core.hashing.iolevel",m_FileHasher->ioLevel());
+ {
+  QStringList batchAlgorithms;
+  for (int i = 0, n = m_FileHasher->batchHashAlgorithms().count(); i < n; i++)
+  {
+   batchAlgorithms.append(CCryptographicHash::name(m_FileHasher->batchHashAlgorithms().at(i)));
+  }
+  m_Settings->setValue("core.hashing.batchalgorithms",batchAlgorithms);
+ }
  //
  m_Settings->setValue("core.md5format.header",m_FileHasher->doWriteHeader());
  m_Settings->setValue("core.md5format.comment",m_FileHasher->commentCharacter());
@@ -285,6 +314,59 @@ void MainWindow::restoreSettings(void)
  m_FileHasher->setTextEncoding(m_Settings->value("core.encoding",m_FileHasher->textEncoding()).toString());
  m_FileHasher->setHashAlgorithm((CCryptographicHash::Algorithm)
   m_Settings->value("core.algorithm",m_FileHasher->hashAlgorithm()).toInt());
+ m_FileHasher->setWorkerCount(
+  m_Settings->value("core.hashing.workers",m_FileHasher->workerCount()).toInt());
+ m_FileHasher->setReadMode((CFileHashingThread::ReadMode)
+  m_Settings->value("core.hashing.readmode",m_FileHasher->readMode()).toInt());
+ m_FileHasher->doUseHugePages() =
+  m_Settings->value("core.hashing.hugepages",m_FileHasher->doUseHugePages()).toBool();
+ m_FileHasher->doUseIoUring() =
+  m_Settings->value("core.hashing.iouring",m_FileHasher->doUseIoUring()).toBool();
+ m_FileHasher->doScheduleByDevice() =
+  m_Settings->value("core.hashing.perdevice",m_FileHasher->doScheduleByDevice()).toBool();
+ m_FileHasher->doScheduleLargestFirst() =
+  m_Settings->value("core.hashing.largestfirst",m_FileHasher->doScheduleLargestFirst()).toBool();
+ m_FileHasher->doAutoTune() =
+  m_Settings->value("core.hashing.autotune",m_FileHasher->doAutoTune()).toBool();
+ m_FileHasher->setProgressRate(
+  m_Settings->value("core.hashing.progressrate",m_FileHasher->progressRate()).toInt());
+ m_FileHasher->doHashBatchInParallel() =
+  m_Settings->value("core.hashing.batchthreads",m_FileHasher->doHashBatchInParallel()).toBool();
+ m_FileHasher->doSplitLargeFiles() =
+  m_Settings->value("core.hashing.splitfiles",m_FileHasher->doSplitLargeFiles()).toBool();
+ m_FileHasher->doHashFilesInLanes() =
+  m_Settings->value("core.hashing.lanes",m_FileHasher->doHashFilesInLanes()).toBool();
+ m_FileHasher->doUseCheckpoints() =
+  m_Settings->value("core.hashing.checkpoints",m_FileHasher->doUseCheckpoints()).toBool();
+ m_FileHasher->checkpointDirectory() =
+  m_Settings->value("core.hashing.checkpointdir",m_FileHasher->checkpointDirectory()).toString();
+ m_FileHasher->setPlacementMode((CCpuPlacement::Mode)
+  m_Settings->value("core.hashing.placement",m_FileHasher->placementMode()).toInt());
+ m_FileHasher->workerCpus() =
+  m_Settings->value("core.hashing.cpus",m_FileHasher->workerCpus()).toString();
+ m_FileHasher->reservedCpus() =
+  m_Settings->value("core.hashing.reservedcpus",m_FileHasher->reservedCpus()).toString();
+ m_FileHasher->setThreadPriority((QThread::Priority)
+  m_Settings->value("core.hashing.priority",m_FileHasher->threadPriority()).toInt());
+ m_FileHasher->setByteRateLimit(
+  m_Settings->value("core.hashing.ratelimit",m_FileHasher->byteRateLimit()).toLongLong());
+ m_FileHasher->setDutyCycle(
+  m_Settings->value("core.hashing.dutycycle",m_FileHasher->dutyCycle()).toInt());
+ m_FileHasher->setIoPriority((CHashingThrottle::IoClass)
+  m_Settings->value("core.hashing.ioclass",m_FileHasher->ioClass()).toInt(),
+  m_Settings->value("core.hashing.iolevel",m_FileHasher->ioLevel()).toInt());
+ {
+  // names of algorithms computed in the same pass, one checksum file each
+  const QStringList batchAlgorithms =
+   m_Settings->value("core.hashing.batchalgorithms").toStringList();
+  m_FileHasher->batchHashAlgorithms().clear();
+  for (int i = 0, n = batchAlgorithms.count(); i < n; i++)
+  {
+   CCryptographicHash::Algorithm algorithm = CCryptographicHash::algorithm(batchAlgorithms.at(i));
+   if (CCryptographicHash::AlgorithmCount != algorithm)
+   {
+    m_FileHasher->batchHashAlgorithms().append(algorithm);
+ }}}
  // read core settings
  m_FileHasher->doWriteHeader() =
   m_Settings->value("core.md5format.header",m_FileHasher->doWriteHeader()).toBool();
@@ -452,6 +534,8 @@ void MainWindow::calculateStringOrFileHash(void)
  if (ui->checkBoxShowAllStringHashes->isChecked())
  {
   multi_hash.enableAllMethods();
+  // file contents are hashed by all algorithms at once, one thread each
+  multi_hash.setParallel(ui->checkBoxUseFileContents->isChecked());
   ui->tableWidgetStringHash->setVisible(true);
  }
  else
@@ -975,6 +1059,7 @@ void MainWindow::saveChecksumFile(void)
     fileName.append(".").append(ext);
    }
    m_FileHasher->saveChecksumFile(fileName);
+   m_FileHasher->saveBatchChecksumFiles(fileName);
  }}
 }
 
@@ -1327,58 +1412,79 @@ void MainWindow::updateFileProgress(void)
  ui->progressBarFile->setValue(m_FileHasher->currentFileProgress());
 }
 
-void MainWindow::doneFileProcessing(void)
+void MainWindow::showFileStatus(const int fileIndex)
 {
- int fileIndex = m_FileHasher->currentFileIndex();
- ui->progressBarTotal->setValue(m_FileHasher->totalFileProgress());
-#ifdef FEATURE_AUTOSCROLL
- {
-  QScrollBar *sb = ui->tableWidget->verticalScrollBar();
-  sb->setValue(sb->value()+sb->singleStep());
- }
-#endif
- QString fileName = m_FileHasher->sourceFilePath(fileIndex);
  QString fileHash = m_FileHasher->calculatedFileHash(fileIndex);
- QString statusText;
- ui->listWidgetAllFiles->addItem(fileName);
- switch (m_FileHasher->currentFileStatus())
+ CFileHasher::FileStatus fileStatus = m_FileHasher->calculatedFileStatus(fileIndex);
+ switch (fileStatus)
  {
   case CFileHasher::Good:
   {
    ui->tableWidget->item(fileIndex,1)->setText(fileHash);
    ui->tableWidget->item(fileIndex,0)->setIcon(*m_IconGood);
-   statusText = m_FileHasher->statusName(m_FileHasher->currentFileStatus());//tr("Good");
    break;
   }
   case CFileHasher::NoAccess:
   {
-   ui->listWidgetAccessFailedFiles->addItem(fileName);
    ui->tableWidget->item(fileIndex,0)->setIcon(*m_IconError);
-   statusText = m_FileHasher->statusName(m_FileHasher->currentFileStatus());//tr("Inaccessible");
    break;
   }
   case CFileHasher::HashMatch:
   {
    ui->tableWidget->item(fileIndex,1)->setText(fileHash);
    ui->tableWidget->item(fileIndex,0)->setIcon(*m_IconGood);
-   statusText = m_FileHasher->statusName(m_FileHasher->currentFileStatus());//tr("Match");
    break;
   }
   case CFileHasher::HashMismatch:
   {
    ui->tableWidget->item(fileIndex,1)->setText(fileHash);
    ui->tableWidget->item(fileIndex,0)->setIcon(*m_IconError);
-   statusText = m_FileHasher->statusName(m_FileHasher->currentFileStatus());//tr("Mismatch");
    break;
   }
+  case CFileHasher::Unchecked:
+  {
+   ui->tableWidget->item(fileIndex,0)->setIcon(*m_IconUnchecked);
+   break;
+  }
+ }
+ ui->tableWidget->item(fileIndex,0)->setText(m_FileHasher->statusName(fileStatus));
+}
+
+void MainWindow::doneFileProcessing(void)
+{
+ const QVector<int>& fileIndices = m_FileHasher->recentFileIndices();
+ ui->progressBarTotal->setValue(m_FileHasher->totalFileProgress());
+#ifdef FEATURE_AUTOSCROLL
+ {
+  QScrollBar *sb = ui->tableWidget->verticalScrollBar();
+  sb->setValue(sb->value()+sb->singleStep()*fileIndices.count());
+ }
+#endif
+ // files finished since the previous notification come in one batch
+ for (int i = 0, n = fileIndices.count(); i < n; i++)
+ {
+  const int fileIndex = fileIndices.at(i);
+  if ((fileIndex >= m_FileHasher->sourceFilesCount()) ||
+      (CFileHasher::Unchecked == m_FileHasher->calculatedFileStatus(fileIndex))) continue;
+  QString fileName = m_FileHasher->sourceFilePath(fileIndex);
+  ui->listWidgetAllFiles->addItem(fileName);
+  if (CFileHasher::NoAccess == m_FileHasher->calculatedFileStatus(fileIndex))
+  {
+   ui->listWidgetAccessFailedFiles->addItem(fileName);
+  }
+  showFileStatus(fileIndex);
  }
- ui->tableWidget->item(fileIndex,0)->setText(statusText);
  ui->tableWidget->resizeColumnsToContents();
  showCounters();
  QApplication::processEvents();
  //
  if (m_FileHasher->hashingStopped())
  {
+  // workers may have finished or dropped files without notifying about each one
+  for (int i = 0, n = m_FileHasher->sourceFilesCount(); i < n; i++)
+  {
+   showFileStatus(i);
+  }
   ui->statusBar->showMessage(tr("Creating report ..."));
   //
   m_FileHasher->doKeepMissingFiles() = !ui->checkBoxRemoveMissingFiles->isChecked();
@@ -82,6 +82,8 @@ private:
  void restoreSettings(void);
  /** \brief Processes command line parameters and applies options. */
  void processArguments(void);
+ /** \brief Shows status and hash of a processed file in the hashing table. */
+ void showFileStatus(const int fileIndex);
  void setAccessible(QWidget& widget, const bool state);
  void setAccessible(QAction& action, const bool state);
  void setAccessible(QWidget* widget, const bool state) { setAccessible(*widget,state); }
@@ -0,0 +1,80 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multibufferhash.h"
+
+int CMultiBufferHash::lanes(const CCryptographicHash::Algorithm method)
+{
+ switch (method)
+ {
+#ifdef FEATURE_LIB_RHASH
+  case CCryptographicHash::Md5: return rhash::md5_multi_lanes();
+#endif
+#if defined FEATURE_LIB_TOMCRYPT_SHA224 || defined FEATURE_LIB_TOMCRYPT_SHA256
+  case CCryptographicHash::Sha224:
+  case CCryptographicHash::Sha256: return ltc::ltc_sha256_multi_lanes();
+#endif
+  default: return 0;
+ }
+}
+
+void CMultiBufferHash::hash(const CCryptographicHash::Algorithm method,
+                            const QVector<const char*>& data, const QVector<int>& lengths,
+                            QVector<QByteArray>& hashes)
+{
+ const int n = data.count();
+ const int size = CCryptographicHash::digestSize(method);
+ QVector<const unsigned char*> in(n);
+ QVector<unsigned long> inlen(n);
+ QVector<unsigned char*> out(n);
+ hashes.resize(n);
+ for (int i = 0; i < n; i++)
+ {
+  in[i] = (const unsigned char *)data.at(i);
+  inlen[i] = (unsigned long)lengths.at(i);
+  hashes[i].resize(size);
+  out[i] = (unsigned char *)hashes[i].data();
+ }
+ switch (method)
+ {
+#ifdef FEATURE_LIB_RHASH
+  case CCryptographicHash::Md5:
+  {
+   QVector<size_t> sizes(n);
+   for (int i = 0; i < n; i++) sizes[i] = (size_t)lengths.at(i);
+   rhash::md5_multi(in.constData(),sizes.constData(),out.constData(),n);
+   return;
+  }
+#endif
+#ifdef FEATURE_LIB_TOMCRYPT_SHA224
+  case CCryptographicHash::Sha224: { ltc::ltc_sha224_multi(in.constData(),inlen.constData(),out.data(),n); return; }
+#endif
+#ifdef FEATURE_LIB_TOMCRYPT_SHA256
+  case CCryptographicHash::Sha256: { ltc::ltc_sha256_multi(in.constData(),inlen.constData(),out.data(),n); return; }
+#endif
+  default: break;
+ }
+ // algorithms without an engine hash one message after another
+ CCryptographicHash hashFunction(method);
+ for (int i = 0; i < n; i++)
+ {
+  hashFunction.reset(lengths.at(i));
+  hashFunction.addData(data.at(i),lengths.at(i));
+  hashes[i] = hashFunction.result();
+ }
+}
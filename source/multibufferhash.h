@@ -0,0 +1,45 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MULTIBUFFERHASH_H
+#define MULTIBUFFERHASH_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+#include "cryptohash.h"
+
+/** \brief Hashes many small messages side by side, one message per lane of a
+    vector register.
+
+    Lanes of messages that are done take on the following ones, the last few
+    messages are finished one by one. Hashes are the same CCryptographicHash
+    gives for each message alone. */
+class CMultiBufferHash
+{
+ public:
+  /** \brief Number of messages hashed at once by the algorithm on this CPU,
+      0 if it has no engine or a single stream is faster. */
+  static int lanes(const CCryptographicHash::Algorithm method);
+  /** \brief Hashes messages given by their data and lengths, hashes are
+      returned in the same order. */
+  static void hash(const CCryptographicHash::Algorithm method,
+                   const QVector<const char*>& data, const QVector<int>& lengths,
+                   QVector<QByteArray>& hashes);
+};
+
+#endif // MULTIBUFFERHASH_H
@@ -16,11 +16,83 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include "cryptohash.h"
 #include "multihash.h"
 
+/** \brief Computes a single algorithm of a multi-hash on a thread of its own.
+
+    Blocks are queued by reference, a block shared by several lanes is
+    released by the last of them. The queue is short, a lane that falls
+    behind holds up the producer instead of piling up data. */
+class CMultiHashLane : public QThread
+{
+ private:
+  CCryptographicHash m_Hash;
+  QMutex m_Mutex;
+  QWaitCondition m_Changed;
+  QList<QByteArray> m_Blocks;
+  int m_Depth;
+  bool m_Busy;
+  bool m_Stopped;
+ public:
+  const CCryptographicMultiHash::Algorithm method;
+  /** \brief Context of the lane, to be touched only while the lane is drained. */
+  CCryptographicHash& hash(void) { return m_Hash; }
+  void push(const QByteArray& block)
+  {
+   QMutexLocker locker(&m_Mutex);
+   while (m_Blocks.count() >= m_Depth) m_Changed.wait(&m_Mutex);
+   m_Blocks.append(block);
+   m_Changed.wakeAll();
+  }
+  /** \brief Waits until all queued blocks are hashed. */
+  void drain(void)
+  {
+   QMutexLocker locker(&m_Mutex);
+   while (!m_Blocks.isEmpty() || m_Busy) m_Changed.wait(&m_Mutex);
+  }
+  void stop(void)
+  {
+   {
+    QMutexLocker locker(&m_Mutex);
+    m_Stopped = true;
+    m_Changed.wakeAll();
+   }
+   wait();
+  }
+  void run(void)
+  {
+   QMutexLocker locker(&m_Mutex);
+   for (;;)
+   {
+    while (m_Blocks.isEmpty() && !m_Stopped) m_Changed.wait(&m_Mutex);
+    if (m_Stopped) break;
+    const QByteArray block = m_Blocks.takeFirst();
+    m_Busy = true;
+    m_Changed.wakeAll();
+    locker.unlock();
+    m_Hash.addData(block);
+    locker.relock();
+    m_Busy = false;
+    m_Changed.wakeAll();
+   }
+  }
+  CMultiHashLane(const CCryptographicMultiHash::Algorithm algorithm,
+                 const CCryptographicHash::Algorithm hashAlgorithm)
+   : m_Hash(hashAlgorithm), m_Depth(4), m_Busy(false), m_Stopped(false),
+     method(algorithm) {}
+};
+
 CCryptographicMultiHash::CCryptographicMultiHash(Algorithm method, const qint64 size)
 {
  m_Dirty = false;
+ m_Parallel = false;
+ m_ParallelThreshold = 0x100000;
+ m_Inline = false;
  m_Method = method;
  m_Methods.insert(method);
 #ifdef FEATURE_LIB_RHASH
@@ -38,6 +110,11 @@ CCryptographicMultiHash::CCryptographicMultiHash(Algorithm method, const qint64
  m_QtHashMd4 = new QCryptographicHash(QCryptographicHash::Md4);
 #ifdef FEATURE_PREFER_QT_NATIVE_HASH
  m_QtHashMd5 = new QCryptographicHash(QCryptographicHash::Md5);
+ m_QtHashSha1 = NULL;
+#ifdef FEATURE_LIB_RHASH
+ // SHA extensions of the CPU make rhash outrun Qt
+ if (!rhash::sha1_accelerated())
+#endif
  m_QtHashSha1 = new QCryptographicHash(QCryptographicHash::Sha1);
 #endif
 #endif
@@ -47,11 +124,19 @@ CCryptographicMultiHash::CCryptographicMultiHash(Algorithm method, const qint64
 CCryptographicMultiHash::CCryptographicMultiHash(void)
 {
  m_Dirty = false;
+ m_Parallel = false;
+ m_ParallelThreshold = 0x100000;
+ m_Inline = false;
  m_Method = CCryptographicMultiHash::AlgorithmCount;
 #ifdef FEATURE_QT_HASH
  m_QtHashMd4 = new QCryptographicHash(QCryptographicHash::Md4);
 #ifdef FEATURE_PREFER_QT_NATIVE_HASH
  m_QtHashMd5 = new QCryptographicHash(QCryptographicHash::Md5);
+ m_QtHashSha1 = NULL;
+#ifdef FEATURE_LIB_RHASH
+ // SHA extensions of the CPU make rhash outrun Qt
+ if (!rhash::sha1_accelerated())
+#endif
  m_QtHashSha1 = new QCryptographicHash(QCryptographicHash::Sha1);
 #endif
 #endif
@@ -60,6 +145,7 @@ CCryptographicMultiHash::CCryptographicMultiHash(void)
 
 CCryptographicMultiHash::~CCryptographicMultiHash()
 {
+ clearLanes();
 #ifdef FEATURE_QT_HASH
  if (m_QtHashMd4) delete m_QtHashMd4;
 #ifdef FEATURE_PREFER_QT_NATIVE_HASH
@@ -69,6 +155,64 @@ CCryptographicMultiHash::~CCryptographicMultiHash()
 #endif
 }
 
+void CCryptographicMultiHash::setParallel(const bool parallel)
+{
+ if (m_Dirty) return;
+ m_Parallel = parallel;
+ reset(m_Size);
+}
+
+void CCryptographicMultiHash::setupLanes(void)
+{
+ // even a single lane frees the calling thread for other work
+ if (!m_Parallel || m_Methods.isEmpty())
+ {
+  clearLanes();
+  return;
+ }
+ bool current = (m_Lanes.count() == m_Methods.count());
+ for (int i = 0, n = m_Lanes.count(); current && (i < n); i++)
+ {
+  current = m_Methods.contains(m_Lanes.at(i)->method);
+ }
+ if (current) return;
+ clearLanes();
+ QList<Algorithm> methods = m_Methods.toList();
+ for (int i = 0, n = methods.count(); i < n; i++)
+ {
+  // lanes reuse single-algorithm contexts, matched by name
+  CCryptographicHash::Algorithm hashAlgorithm = CCryptographicHash::algorithm(name(methods.at(i)));
+  if (CCryptographicHash::AlgorithmCount == hashAlgorithm)
+  {
+   clearLanes();
+   return;
+  }
+  m_Lanes.append(new CMultiHashLane(methods.at(i),hashAlgorithm));
+ }
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  m_Lanes.at(i)->start();
+ }
+}
+
+void CCryptographicMultiHash::clearLanes(void)
+{
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  m_Lanes.at(i)->stop();
+  delete m_Lanes.at(i);
+ }
+ m_Lanes.clear();
+}
+
+void CCryptographicMultiHash::drainLanes(void)
+{
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  m_Lanes.at(i)->drain();
+ }
+}
+
 QSet<CCryptographicMultiHash::Algorithm> CCryptographicMultiHash::methods(void)
 {
  return m_Methods;
@@ -142,12 +286,32 @@ void CCryptographicMultiHash::disableAllMethods(void)
 void CCryptographicMultiHash::reset(const qint64 size)
 {
  m_Size = size;
+ drainLanes();
+ setupLanes();
+ if (!m_Lanes.isEmpty())
+ {
+  for (int i = 0, n = m_Lanes.count(); i < n; i++)
+  {
+   m_Lanes.at(i)->hash().reset(size);
+  }
+  // handing small messages over to threads costs more than it saves
+  m_Inline = (size > 0) && (size < m_ParallelThreshold);
+  m_Result.clear();
+  m_Dirty = false;
+  return;
+ }
 #ifdef FEATURE_LIB_RHASH
  int rhash_flags = 0;
  if (m_Methods.contains(Crc32)) { rhash_flags |= rhash::FLAG_CRC32; }
+ // digests computed by Qt are not computed twice
+#if defined FEATURE_QT_HASH && defined FEATURE_PREFER_QT_NATIVE_HASH
+ if (m_Methods.contains(Md5) && !m_QtHashMd5)   { rhash_flags |= rhash::FLAG_MD5; }
+ if (m_Methods.contains(Sha1) && !m_QtHashSha1) { rhash_flags |= rhash::FLAG_SHA1; }
+#else
  if (m_Methods.contains(Md5))   { rhash_flags |= rhash::FLAG_MD5; }
- if (m_Methods.contains(Ed2k))  { rhash_flags |= rhash::FLAG_ED2K; }
  if (m_Methods.contains(Sha1))  { rhash_flags |= rhash::FLAG_SHA1; }
+#endif
+ if (m_Methods.contains(Ed2k))  { rhash_flags |= rhash::FLAG_ED2K; }
 #ifdef FEATURE_LIB_RHASH_TIGER
  if (m_Methods.contains(Tiger)) { rhash_flags |= rhash::FLAG_TIGER; }
 #endif
@@ -219,9 +383,25 @@ void CCryptographicMultiHash::reset(const qint64 size)
 
 void CCryptographicMultiHash::addData(const char *data, int length)
 {
+ if (!m_Lanes.isEmpty())
+ {
+  if (m_Inline)
+  {
+   for (int i = 0, n = m_Lanes.count(); i < n; i++)
+   {
+    m_Lanes.at(i)->hash().addData(data,length);
+  }}
+  else
+  {
+   // the caller may reuse its buffer, lanes get a copy they share
+   pushBlock(QByteArray(data,length));
+  }
+  m_Dirty = true;
+  return;
+ }
 #ifdef FEATURE_LIB_RHASH
 #ifdef FEATURE_QT_HASH
- if (m_Methods.contains(Crc32)||
+ if (m_Methods.contains(Crc32)||m_Methods.contains(Ed2k)||
      m_Methods.contains(Tth)||m_Methods.contains(Aich)||
 #ifdef FEATURE_LIB_RHASH_TIGER
      m_Methods.contains(Tiger)||
@@ -274,12 +454,36 @@ void CCryptographicMultiHash::addData(const char *data, int length)
 
 void CCryptographicMultiHash::addData(const QByteArray &data)
 {
+ // implicitly shared data is passed to lanes without copying
+ if (!m_Lanes.isEmpty() && !m_Inline)
+ {
+  pushBlock(data);
+  m_Dirty = true;
+  return;
+ }
  addData(data.constData(), data.length());
 }
 
+void CCryptographicMultiHash::pushBlock(const QByteArray& block)
+{
+ for (int i = 0, n = m_Lanes.count(); i < n; i++)
+ {
+  m_Lanes.at(i)->push(block);
+ }
+}
+
 QByteArray CCryptographicMultiHash::result(Algorithm method)
 {
  m_Result.clear();
+ if (!m_Lanes.isEmpty())
+ {
+  drainLanes();
+  for (int i = 0, n = m_Lanes.count(); i < n; i++)
+  {
+   if (method == m_Lanes.at(i)->method) m_Result = m_Lanes.at(i)->hash().result();
+  }
+  return m_Result;
+ }
 #ifdef FEATURE_LIB_RHASH
  {
   rhash::crc_context context = m_Context_rhash.state;
@@ -382,7 +586,7 @@ QByteArray CCryptographicMultiHash::result(Algorithm method)
  if (m_Methods.contains(Md5)&&(Md5==method))
  {
   ltc_context_t context = m_Context_ltc;
-  ltc::ltc_md5_done(&context.md5state,(unsigned char *)&m_Context_ltc.md4digest);
+  ltc::ltc_md5_done(&context.md5state,(unsigned char *)&m_Context_ltc.md5digest);
   m_Result = QByteArray((const char *)&m_Context_ltc.md5digest,
                         sizeof(m_Context_ltc.md5digest));
  }
@@ -52,6 +52,8 @@ namespace ltc
 }
 #endif
 
+class CMultiHashLane;
+
 class CCryptographicMultiHash : public QObject
 {
  Q_OBJECT
@@ -156,6 +158,25 @@ class CCryptographicMultiHash : public QObject
   qint64 m_Size;
   QByteArray m_Result;
   bool m_Dirty;
+  /** \brief Threads computing enabled algorithms, one per algorithm, if parallel. */
+  QList<CMultiHashLane*> m_Lanes;
+  bool m_Parallel;
+  /** \brief Messages of known size below this are hashed by the calling thread. */
+  qint64 m_ParallelThreshold;
+  /** \brief Current message is hashed by the calling thread, lanes are idle. */
+  bool m_Inline;
+  void setupLanes(void);
+  void clearLanes(void);
+  void drainLanes(void);
+  void pushBlock(const QByteArray& block);
+ public:
+  /** \brief Computes each enabled algorithm on a thread of its own.
+
+      Every block of data is handed over to all algorithm threads at once,
+      they share a single copy of it. Resets the hash itself, so it is ignored
+      once data has been added and until the next reset(). */
+  void setParallel(const bool parallel);
+  bool parallel(void) { return m_Parallel; }
  public:
   /** \brief Returns the set of enabled hashing algorithm identifiers. */
   QSet<Algorithm> methods(void);
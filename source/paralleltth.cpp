@@ -0,0 +1,161 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include "paralleltth.h"
+
+#if defined(FEATURE_LIB_RHASH) && defined(FEATURE_LIB_RHASH_TTH)
+
+static const unsigned LeafSize = 1024;
+// subtrees of fewer leaves are not worth handing to another thread
+static const int MinimumPieceLevel = 6;
+
+struct tth_piece_t
+{
+ const unsigned char *data;
+ unsigned level;
+ unsigned char root[24];
+};
+
+/** \brief Work shared by the caller and its helpers, the last one to leave deletes it. */
+struct tth_job_t
+{
+ QAtomicInt references;
+ QAtomicInt next;
+ QSemaphore done;
+ QVector<tth_piece_t> pieces;
+ // helpers go through a plain pointer, the vector is not touched while they run
+ tth_piece_t *list;
+ int count;
+ void process(void)
+ {
+  for (int i; (i = next.fetchAndAddOrdered(1)) < count; )
+  {
+   tth_piece_t& piece = list[i];
+   rhash::tth_subtree(piece.data,piece.level,piece.root);
+   done.release();
+  }
+ }
+ void release(void)
+ {
+  if (!references.deref()) delete this;
+ }
+};
+
+class CTthHelper : public QRunnable
+{
+ private:
+  tth_job_t *m_Job;
+  CCpuPlacement *m_Placement;
+  int m_Worker;
+  CHashingThrottle::pace_t *m_Pace;
+ public:
+  void run(void)
+  {
+   // threads of the pool serve any worker, so they are placed for every run
+   if (m_Placement) m_Placement->apply(m_Worker);
+   const qint64 start = m_Pace ? CHashingThrottle::threadCpuTime() : -1;
+   m_Job->process();
+   if (start >= 0)
+   {
+    m_Pace->helperTime.fetchAndAddOrdered((int)(CHashingThrottle::threadCpuTime()-start));
+  }}
+  CTthHelper(tth_job_t *job, CCpuPlacement *placement, const int worker,
+             CHashingThrottle::pace_t *pace) :
+   m_Job(job), m_Placement(placement), m_Worker(worker), m_Pace(pace)
+  {
+   m_Job->references.ref();
+  }
+  ~CTthHelper() { m_Job->release(); }
+};
+
+CParallelTth::CParallelTth(QThreadPool *pool, CCpuPlacement *placement, const int worker,
+                           CHashingThrottle::pace_t *pace)
+{
+ m_Pool = pool;
+ m_Placement = placement;
+ m_Worker = worker;
+ m_Pace = pace;
+}
+
+void CParallelTth::update(rhash::tth_ctx *context, const unsigned char *data, unsigned size)
+{
+ // a partial leaf left from previous data is completed the usual way
+ if (!tth_on_leaf_boundary(context))
+ {
+  const unsigned head = qMin(size,LeafSize+1-(unsigned)context->tiger.length);
+  rhash::tth_update(context,data,head);
+  data += head;
+  size -= head;
+ }
+ // the pool is sized to CPUs not taken by workers, so helpers do not
+ // oversubscribe the machine however many workers hash trees at once
+ const int idle = m_Pool->maxThreadCount() - m_Pool->activeThreadCount();
+ if ((size < MinimumSize) || (idle <= 0))
+ {
+  rhash::tth_update(context,data,size);
+  return;
+ }
+ // a couple of pieces per thread, so a slow thread does not hold up the rest
+ unsigned leaves = size/LeafSize;
+ unsigned maxLevel = MinimumPieceLevel;
+ while ((2u << maxLevel) <= leaves/(2*(idle+1))) maxLevel++;
+ // a subtree starts where the leaf count has its lowest set bit, or deeper
+ tth_job_t *job = new tth_job_t;
+ job->references = 1;
+ job->next = 0;
+ quint64 count = context->block_count;
+ const unsigned char *piece = data;
+ while (leaves > 0)
+ {
+  unsigned level = maxLevel;
+  while ((count & ((Q_UINT64_C(1) << level)-1)) || ((1u << level) > leaves)) level--;
+  tth_piece_t p;
+  p.data = piece;
+  p.level = level;
+  job->pieces.append(p);
+  piece += LeafSize << level;
+  count += Q_UINT64_C(1) << level;
+  leaves -= 1u << level;
+ }
+ const int n = job->count = job->pieces.count();
+ job->list = job->pieces.data();
+ for (int i = qMin(idle,n-1); i > 0; i--)
+ {
+  CTthHelper *helper = new CTthHelper(job,m_Placement,m_Worker,m_Pace);
+  if (!m_Pool->tryStart(helper))
+  {
+   delete helper;
+   break;
+ }}
+ job->process();
+ // helpers may still be busy with the last pieces they took
+ job->done.acquire(n);
+ for (int i = 0; i < n; i++)
+ {
+  rhash::tth_merge_subtree(context,job->list[i].root,job->list[i].level);
+ }
+ job->release();
+ rhash::tth_update(context,piece,size-(unsigned)(piece-data));
+}
+
+#endif
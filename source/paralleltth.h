@@ -0,0 +1,67 @@
+/*
+    QFileHasher * Cryptographic hash calculation and verification utility
+    Copyright (C) 2009-2011 Mirai Computing (mirai.computing@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLELTTH_H
+#define PARALLELTTH_H
+
+#include <QtCore/QtGlobal>
+#include "feature.h"
+#include "cpuplacement.h"
+#include "hashingthrottle.h"
+
+class QThreadPool;
+
+#ifdef FEATURE_LIB_RHASH
+namespace rhash
+{
+ #include "crc_sums.h"
+}
+#endif
+
+#if defined(FEATURE_LIB_RHASH) && defined(FEATURE_LIB_RHASH_TTH)
+
+/** \brief Feeds large blocks of data into a TTH context using several threads.
+
+    Whole leaves are split into runs aligned to powers of two, so that every
+    run is a complete subtree of the final hash tree. Subtrees are hashed by
+    the calling thread together with idle threads of a pool of the job, which
+    holds as many threads as CPUs are left over by its workers. Helpers run
+    on the CPUs of the worker they help, and their CPU time counts towards
+    its share. Roots of subtrees are merged into the context in order
+    afterwards, the result is the same tth_final would give for the data fed
+    sequentially. */
+class CParallelTth
+{
+ private:
+  QThreadPool *m_Pool;
+  CCpuPlacement *m_Placement;
+  int m_Worker;
+  CHashingThrottle::pace_t *m_Pace;
+ public:
+  /** \brief Blocks smaller than this are hashed by the calling thread alone. */
+  static const unsigned MinimumSize = 0x40000;
+  void update(rhash::tth_ctx *context, const unsigned char *data, unsigned size);
+  /** \brief Helpers are taken from given pool, placed on the CPUs of given
+      worker if placement is given, and charged to pace if that is given. */
+  CParallelTth(QThreadPool *pool, CCpuPlacement *placement, const int worker,
+               CHashingThrottle::pace_t *pace);
+};
+
+#endif
+
+#endif // PARALLELTTH_H